@@ -0,0 +1,531 @@
+#include "Bench.h"
+
+#include "NodeGraph.h"
+#include "ThreadPool.h"
+#include "TextureNodes.hpp"
+#include "TextureNodeGraph.hpp"
+#include "TextureNodeRegistry.h"
+#include "ShaderGen.h"
+
+#include <iostream>
+#include <format>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <regex>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedUs(Clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> samples) {
+	if (samples.empty()) return 0.0;
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2];
+}
+
+// as cheap as a node gets, what's measured is the graph's own bookkeeping
+class BenchNode : public Node {
+public:
+	NodeValue solve() override {
+		m_outputs[0].value[0] = m_inputs[0].value[0] + m_inputs[1].value[0] * 0.5f;
+		return m_outputs[0];
+	}
+
+	void setup() override {
+		addInput("A", ValueType::scalar);
+		addInput("B", ValueType::scalar);
+		addOutput("Output", ValueType::scalar);
+	}
+};
+
+/*
+ * Nodes in levels of g_LevelWidth. Every node past the first level reads A from a node of the
+ * level above and B from any earlier node, so edits have a long downstream and levels can run in parallel.
+ */
+struct BenchGraph {
+	static constexpr size_t g_LevelWidth = 32;
+
+	NodeGraph graph;
+	std::vector<BenchNode*> nodes;
+	std::vector<BenchNode*> sourceA, sourceB; // sources of the inputs of each node, nullptr in the first level
+
+	BenchGraph(size_t count, std::mt19937& rng) {
+		graph.beginEdit();
+		for (size_t i = 0; i < count; i++) {
+			nodes.push_back(graph.create<BenchNode>());
+			sourceA.push_back(nullptr);
+			sourceB.push_back(nullptr);
+			if (i < g_LevelWidth) continue;
+
+			const size_t level = i / g_LevelWidth;
+			const size_t a = (level - 1) * g_LevelWidth + rng() % g_LevelWidth;
+			const size_t b = rng() % (level * g_LevelWidth);
+			graph.connect(nodes[a], 0, nodes[i], 0);
+			graph.connect(nodes[b], 0, nodes[i], 1);
+			sourceA[i] = nodes[a];
+			sourceB[i] = nodes[b];
+		}
+		graph.commitEdit();
+	}
+
+	// moves input B of a node past the first level to another earlier node
+	void reconnect(std::mt19937& rng) {
+		const size_t i = g_LevelWidth + rng() % (nodes.size() - g_LevelWidth);
+		BenchNode* source = nodes[rng() % (i / g_LevelWidth * g_LevelWidth)];
+
+		graph.removeConnection(sourceB[i], 0, nodes[i], 1);
+		graph.connect(source, 0, nodes[i], 1);
+		sourceB[i] = source;
+	}
+
+	void markAllDirty() {
+		for (auto node : nodes) node->markDirty();
+	}
+};
+
+/*
+ * NodeGraph before the per-node adjacency lists, kept as the reference: every lookup scans one flat
+ * connection list, each connection edit rebuilds the node path from scratch and solve runs the whole path.
+ * Solves the nodes of a BenchGraph, over a copy of its connections. Path builds give up past the deadline,
+ * they take minutes for the larger graphs.
+ */
+class LinearGraph {
+public:
+	explicit LinearGraph(const BenchGraph& bench) : m_nodes(bench.nodes), m_sourceB(bench.sourceB) {
+		for (size_t i = 0; i < m_nodes.size(); i++) {
+			if (!bench.sourceA[i]) continue;
+			m_connections.push_back({ bench.sourceA[i], m_nodes[i], 0, 0 });
+			m_connections.push_back({ bench.sourceB[i], m_nodes[i], 1, 0 });
+		}
+	}
+
+	void reconnect(std::mt19937& rng) {
+		const size_t i = BenchGraph::g_LevelWidth + rng() % (m_nodes.size() - BenchGraph::g_LevelWidth);
+		BenchNode* source = m_nodes[rng() % (i / BenchGraph::g_LevelWidth * BenchGraph::g_LevelWidth)];
+
+		removeConnection(m_sourceB[i], m_nodes[i], 1);
+		connect(source, m_nodes[i], 1);
+		m_sourceB[i] = source;
+	}
+
+	void connect(Node* source, Node* destination, size_t input) {
+		m_connections.push_back({ source, destination, input, 0 });
+		buildNodePath();
+	}
+
+	void removeConnection(Node* source, Node* destination, size_t input) {
+		auto pos = std::find_if(m_connections.begin(), m_connections.end(), [=](const Connection& cn) {
+			return cn.source == source && cn.destination == destination && cn.destinationInput == input;
+		});
+		if (pos == m_connections.end()) return;
+		m_connections.erase(pos);
+		buildNodePath();
+	}
+
+	// false once the deadline has passed, the path is incomplete
+	bool buildNodePath() {
+		m_nodePath.clear();
+		auto exists = [this](Node* node) { return std::find(m_nodePath.begin(), m_nodePath.end(), node) != m_nodePath.end(); };
+
+		std::vector<Node*> queue;
+		for (auto node : m_nodes) {
+			if (inputConnections(node).empty()) queue.push_back(node);
+		}
+
+		while (!queue.empty()) {
+			if (Clock::now() > m_deadline) {
+				m_timedOut = true;
+				return false;
+			}
+
+			Node* node = queue.front();
+			queue.erase(queue.begin());
+			if (exists(node)) continue;
+
+			for (const auto& conn : outputConnections(node)) queue.push_back(conn.destination);
+
+			bool ready = true;
+			for (const auto& conn : inputConnections(node)) {
+				if (!exists(conn.source)) {
+					ready = false;
+					break;
+				}
+			}
+
+			if (ready) m_nodePath.push_back(node);
+			else queue.push_back(node);
+		}
+		return true;
+	}
+
+	void setDeadline(Clock::time_point deadline) { m_deadline = deadline; }
+	bool timedOut() const { return m_timedOut; }
+
+	void solve() {
+		if (m_nodePath.empty()) buildNodePath();
+
+		for (Node* node : m_nodePath) {
+			node->solve();
+			for (const auto& conn : outputConnections(node)) {
+				conn.destination->input(conn.destinationInput).value = node->texture(conn.sourceOutput).value;
+			}
+		}
+	}
+
+private:
+	std::vector<BenchNode*> m_nodes, m_sourceB;
+	std::vector<Connection> m_connections;
+	std::vector<Node*> m_nodePath;
+
+	Clock::time_point m_deadline{ Clock::time_point::max() };
+	bool m_timedOut{ false };
+
+	std::vector<Connection> inputConnections(Node* node) const {
+		std::vector<Connection> ret;
+		for (const auto& conn : m_connections) {
+			if (conn.destination == node) ret.push_back(conn);
+		}
+		return ret;
+	}
+
+	std::vector<Connection> outputConnections(Node* node) const {
+		std::vector<Connection> ret;
+		for (const auto& conn : m_connections) {
+			if (conn.source == node) ret.push_back(conn);
+		}
+		return ret;
+	}
+};
+
+void benchNodeGraph() {
+	constexpr size_t runs = 9, edits = 100;
+
+	ThreadPool pool{};
+	std::cout << "NodeGraph (median of runs, us)\n";
+
+	for (size_t count : { 100, 1000, 10000 }) {
+		std::mt19937 rng{ uint32_t(count) };
+
+		auto start = Clock::now();
+		BenchGraph bench{ count, rng };
+		const double build = elapsedUs(start);
+
+		std::vector<double> serial, parallel;
+		for (size_t run = 0; run < runs; run++) {
+			bench.markAllDirty();
+			start = Clock::now();
+			bench.graph.solve();
+			serial.push_back(elapsedUs(start));
+
+			bench.graph.setThreadPool(&pool);
+			bench.markAllDirty();
+			start = Clock::now();
+			bench.graph.solve();
+			parallel.push_back(elapsedUs(start));
+			bench.graph.setThreadPool(nullptr);
+		}
+
+		// topology edit: one connection moved, path update and the downstream re-solved
+		std::vector<double> connectionEdits;
+		size_t connectionSolved = 0;
+		for (size_t edit = 0; edit < edits; edit++) {
+			start = Clock::now();
+			bench.reconnect(rng);
+			bench.graph.solve();
+			connectionEdits.push_back(elapsedUs(start));
+			connectionSolved += bench.graph.lastSolveCount();
+		}
+
+		// settings edit: one node and its downstream re-solved, no path update
+		std::vector<double> nodeEdits;
+		size_t nodeSolved = 0;
+		for (size_t edit = 0; edit < edits; edit++) {
+			start = Clock::now();
+			bench.nodes[rng() % count]->markDirty();
+			bench.graph.solve();
+			nodeEdits.push_back(elapsedUs(start));
+			nodeSolved += bench.graph.lastSolveCount();
+		}
+
+		// the reference, within a time budget per graph size
+		constexpr auto baselineBudget = std::chrono::seconds(20);
+		constexpr size_t baselineEdits = 10;
+
+		LinearGraph baseline{ bench };
+		baseline.setDeadline(Clock::now() + baselineBudget);
+
+		start = Clock::now();
+		baseline.buildNodePath();
+		const double baselinePath = elapsedUs(start);
+
+		std::vector<double> baselineSolves, baselineConnectionEdits;
+		for (size_t run = 0; run < runs && !baseline.timedOut(); run++) {
+			start = Clock::now();
+			baseline.solve();
+			baselineSolves.push_back(elapsedUs(start));
+		}
+		for (size_t edit = 0; edit < baselineEdits && !baseline.timedOut(); edit++) {
+			start = Clock::now();
+			baseline.reconnect(rng);
+			baseline.solve();
+			baselineConnectionEdits.push_back(elapsedUs(start));
+		}
+
+		if (baseline.timedOut() && baselineSolves.empty()) {
+			std::cout << std::format("  {:>5} nodes before: path build over {} s, not measured\n", count, baselineBudget.count());
+		}
+		else {
+			// a node edit re-solves the whole path there, same as a full solve
+			std::cout << std::format(
+				"  {:>5} nodes before: path build {:.1f}, solve {:.1f}, connection edit {:.1f}, node edit {:.1f}{}\n",
+				count, baselinePath, median(baselineSolves), median(baselineConnectionEdits), median(baselineSolves),
+				baseline.timedOut() ? " (budget ran out)" : ""
+			);
+		}
+		std::cout << std::format(
+			"  {:>5} nodes after:  build {:.1f}, solve {:.1f}, parallel solve {:.1f} ({} threads), connection edit {:.1f} ({} solved), node edit {:.1f} ({} solved)\n",
+			count, build, median(serial), median(parallel), pool.threadCount(),
+			median(connectionEdits), connectionSolved / edits, median(nodeEdits), nodeSolved / edits
+		);
+	}
+}
+
+// The scanner StringScanner replaced, kept as the reference: every character erased from the front and matched by a regex
+class RegexScanner {
+public:
+	RegexScanner(const std::string& input) : m_data(input.begin(), input.end()) {}
+
+	char peek() const { return m_data.empty() ? '\0' : m_data.front(); }
+	char scan() {
+		if (m_data.empty()) return '\0';
+		char c = m_data.front();
+		m_data.erase(m_data.begin());
+		return c;
+	}
+
+	std::string scanWhile(const std::regex& re) {
+		std::string ret = "";
+		while (peek() != '\0' && std::regex_match(std::string(1, peek()), re)) {
+			ret += scan();
+		}
+		return ret;
+	}
+
+private:
+	std::vector<char> m_data;
+};
+
+// identifiers in src, the walk both scanners do over a library
+static size_t countIdentifiers(const std::string& src) {
+	StringScanner sc{ src };
+	size_t count = 0;
+	while (!sc.atEnd()) {
+		sc.skipSpaces();
+		if (!sc.scanWhile(StringScanner::identifier).empty()) count++;
+		else sc.scan();
+	}
+	return count;
+}
+
+static size_t countIdentifiersRegex(const std::string& src) {
+	const std::regex space("\\s"), identifierName("[a-zA-Z0-9_]");
+	RegexScanner sc{ src };
+	size_t count = 0;
+	while (sc.peek() != '\0') {
+		sc.scanWhile(space);
+		if (!sc.scanWhile(identifierName).empty()) count++;
+		else sc.scan();
+	}
+	return count;
+}
+
+void benchLibraryScan() {
+	constexpr size_t runs = 5;
+
+	// library() of every type the editor can create
+	std::string libraries;
+	size_t types = 0;
+	{
+		NodeEditor editor{ new TextureNodeGraph() };
+		for (const auto& ctor : nodeTypes) {
+			if (!ctor.onCreate) continue;
+			auto node = static_cast<GraphicsNode*>(ctor.onCreate(&editor, ctor.name, ctor.code)->node());
+			libraries += node->library();
+			libraries += '\n';
+			types++;
+		}
+	}
+
+	std::cout << std::format("Library scan, {} node types (median of runs, ms)\n", types);
+	for (size_t copies : { 1, 8 }) {
+		std::string src;
+		for (size_t i = 0; i < copies; i++) src += libraries;
+
+		std::vector<double> regex, scanner, parse;
+		size_t regexTokens = 0, scannerTokens = 0;
+		for (size_t run = 0; run < runs; run++) {
+			auto start = Clock::now();
+			regexTokens = countIdentifiersRegex(src);
+			regex.push_back(elapsedUs(start) / 1000.0);
+
+			start = Clock::now();
+			scannerTokens = countIdentifiers(src);
+			scanner.push_back(elapsedUs(start) / 1000.0);
+
+			start = Clock::now();
+			auto library = ShaderLibrary::create(src);
+			parse.push_back(elapsedUs(start) / 1000.0);
+		}
+
+		std::cout << std::format(
+			"  {:>3} KB: regex scanner {:.3f} ({} identifiers), StringScanner {:.3f} ({} identifiers), ShaderLibrary::create {:.3f}\n",
+			src.size() / 1024, median(regex), regexTokens, median(scanner), scannerTokens, median(parse)
+		);
+	}
+}
+
+/*
+ * Noise through a threshold, mixed with `layers` more noise nodes in a chain, then mixed with
+ * one of two colors into an output. toggle() swaps the color for the other one, a topology edit.
+ */
+struct TextureBenchGraph {
+	TextureNodeGraph graph;
+	ColorNode* colors[2]{};
+	MixNode* last{ nullptr };
+	size_t color{ 0 };
+
+	explicit TextureBenchGraph(size_t layers) {
+		graph.beginEdit();
+
+		Node* previous = graph.create<ThresholdNode>();
+		graph.connect(graph.create<NoiseNode>(), 0, previous, 0);
+		for (size_t i = 0; i < layers; i++) {
+			auto noise = graph.create<NoiseNode>();
+			noise->setParam("Scale", float(i + 2)); // equal nodes would be merged
+			auto mix = graph.create<MixNode>();
+			graph.connect(previous, 0, mix, 0);
+			graph.connect(noise, 0, mix, 1);
+			previous = mix;
+		}
+
+		colors[0] = graph.create<ColorNode>();
+		colors[0]->setParam("Color", 1.0f, 0.5f, 0.0f, 1.0f);
+		colors[1] = graph.create<ColorNode>();
+		colors[1]->setParam("Color", 0.0f, 0.5f, 1.0f, 1.0f);
+
+		last = graph.create<MixNode>();
+		graph.connect(previous, 0, last, 0);
+		graph.connect(colors[color], 0, last, 1);
+		graph.connect(last, 0, graph.create<OutputNode>(), 0);
+
+		graph.commitEdit();
+	}
+
+	void toggle() {
+		graph.removeConnection(colors[color], 0, last, 1);
+		color = 1 - color;
+		graph.connect(colors[color], 0, last, 1);
+	}
+
+	// solved and rendered, with the GPU done
+	void finish() {
+		graph.solve();
+		graph.finishCompile();
+		glFinish();
+	}
+};
+
+void benchEditLatency() {
+	constexpr size_t edits = 20;
+
+	struct Case {
+		const char* name;
+		TextureNodeGraph::Backend backend;
+		bool compile; // no cached programs, the fused backend compiles every edit
+	};
+
+	const Case cases[] = {
+		{ "interpreter", TextureNodeGraph::Backend::interpreter, false },
+		{ "fused, cached", TextureNodeGraph::Backend::fused, false },
+		{ "fused, compiled", TextureNodeGraph::Backend::fused, true }
+	};
+
+	auto& cache = ShaderCache::shared();
+	const std::string diskCache = cache.diskCacheDirectory();
+
+	std::cout << "Edit to pixels, 1024x1024 (median of edits, ms)\n";
+	for (const auto& test : cases) {
+		TextureBenchGraph bench{ 4 };
+		bench.graph.setPipeline(test.backend, TextureNodeGraph::ShaderMode::interactive);
+
+		// both topologies seen once: the interpreter is compiled, the cache holds both programs
+		bench.finish();
+		bench.toggle();
+		bench.finish();
+
+		std::vector<double> samples;
+		for (size_t edit = 0; edit < edits; edit++) {
+			if (test.compile) {
+				cache.setDiskCacheDirectory("");
+				cache.clear();
+			}
+
+			auto start = Clock::now();
+			bench.toggle();
+			bench.finish();
+			samples.push_back(elapsedUs(start) / 1000.0);
+		}
+		cache.setDiskCacheDirectory(diskCache);
+
+		std::cout << std::format("  {}: {:.3f}\n", test.name, median(samples));
+	}
+}
+
+void benchDispatch() {
+	constexpr size_t runs = 21;
+
+	const std::pair<const char*, TextureNodeGraph::ShaderMode> modes[] = {
+		{ "interactive", TextureNodeGraph::ShaderMode::interactive },
+		{ "baked", TextureNodeGraph::ShaderMode::baked }
+	};
+
+	TextureBenchGraph bench{ 8 };
+
+	std::vector<GLuint> queries(runs);
+	glGenQueries(GLsizei(runs), queries.data());
+
+	std::cout << "Fused render (median of runs, GPU / CPU ms)\n";
+	for (uint32_t size : { 1024u, 2048u }) {
+		for (const auto& [name, mode] : modes) {
+			bench.graph.setPipeline(TextureNodeGraph::Backend::fused, mode);
+			bench.finish();
+
+			// first run at this size allocates the images
+			bench.graph.render(size, size);
+			glFinish();
+
+			std::vector<double> gpu, cpu;
+			for (size_t run = 0; run < runs; run++) {
+				glBeginQuery(GL_TIME_ELAPSED, queries[run]);
+				auto start = Clock::now();
+				bench.graph.render(size, size);
+				cpu.push_back(elapsedUs(start) / 1000.0);
+				glEndQuery(GL_TIME_ELAPSED);
+			}
+
+			for (size_t run = 0; run < runs; run++) {
+				GLuint64 time = 0;
+				glGetQueryObjectui64v(queries[run], GL_QUERY_RESULT, &time);
+				gpu.push_back(double(time) / 1e6);
+			}
+
+			std::cout << std::format("  {}x{} {}: {:.3f} / {:.3f}\n", size, size, name, median(gpu), median(cpu));
+		}
+	}
+
+	glDeleteQueries(GLsizei(runs), queries.data());
+}
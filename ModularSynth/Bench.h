@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+ * Micro-benchmarks, run instead of the editor with --bench. Results are printed to stdout,
+ * one line per case, so runs before and after a change can be diffed.
+ */
+
+// NodeGraph build, full solve, connection edit and single node edit for 100, 1k and 10k nodes,
+// next to the flat connection list NodeGraph used before. CPU only
+void benchNodeGraph();
+
+// Tokenizing and parsing the libraries of every registered node type, with StringScanner and the regex scanner it replaced
+void benchLibraryScan();
+
+// Time from a topology edit to its pixels being rendered, for the interpreter and the fused backend
+// (program found in the cache, and compiled). Needs a GL context
+void benchEditLatency();
+
+// GPU and CPU time of a fused render with interactive (uniform) and baked (literal) params. Needs a GL context
+void benchDispatch();
@@ -0,0 +1,117 @@
+#include "GpuProfiler.h"
+
+#include <format>
+
+GpuProfiler::~GpuProfiler() {
+	for (auto& frame : m_frames) {
+		if (!frame.queries.empty()) {
+			glDeleteQueries(GLsizei(frame.queries.size()), frame.queries.data());
+		}
+	}
+}
+
+GpuProfiler& GpuProfiler::shared() {
+	static GpuProfiler profiler{};
+	return profiler;
+}
+
+void GpuProfiler::setEnabled(bool enabled) {
+	m_enabled = enabled;
+	m_open.clear();
+	for (auto& frame : m_frames) {
+		frame.scopes.clear();
+		frame.pending = false;
+	}
+}
+
+void GpuProfiler::beginFrame() {
+	if (!m_enabled) return;
+
+	// scopes left open end with the frame, every query of the frame is issued
+	while (!m_open.empty()) {
+		end();
+	}
+
+	Frame& ended = m_frames[m_current];
+	ended.index = m_frameIndex++;
+	ended.pending = !ended.scopes.empty();
+
+	// oldest first, a frame can't be done before the ones it follows
+	for (size_t i = 1; i <= g_FrameLatency; i++) {
+		Frame& frame = m_frames[(m_current + i) % g_FrameLatency];
+		if (frame.pending && !collect(frame)) break;
+	}
+
+	m_current = (m_current + 1) % g_FrameLatency;
+	Frame& next = m_frames[m_current];
+	if (next.pending) {
+		m_dropped++;
+		next.pending = false;
+	}
+	next.scopes.clear();
+}
+
+void GpuProfiler::begin(std::string_view name) {
+	if (!m_enabled) return;
+
+	Frame& frame = m_frames[m_current];
+	const size_t index = frame.scopes.size();
+	frame.scopes.push_back({ .name = std::string(name), .depth = uint32_t(m_open.size()) });
+
+	if (frame.queries.size() < (index + 1) * 2) {
+		const size_t count = frame.queries.size();
+		frame.queries.resize((index + 1) * 2);
+		glGenQueries(GLsizei(frame.queries.size() - count), frame.queries.data() + count);
+	}
+
+	glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+	frame.last = frame.queries[index * 2];
+	m_open.push_back({ index, Clock::now() });
+}
+
+void GpuProfiler::end() {
+	if (!m_enabled || m_open.empty()) return;
+
+	auto [index, start] = m_open.back();
+	m_open.pop_back();
+
+	Frame& frame = m_frames[m_current];
+	glQueryCounter(frame.queries[index * 2 + 1], GL_TIMESTAMP);
+	frame.last = frame.queries[index * 2 + 1];
+	frame.scopes[index].cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// reads the frame's timestamps if they are all available, without waiting.
+// The last query issued is the last one written, outer scopes end after the last scope began.
+bool GpuProfiler::collect(Frame& frame) {
+	GLint available = 0;
+	glGetQueryObjectiv(frame.last, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return false;
+
+	FrameStats stats{ .frame = frame.index };
+	for (size_t i = 0; i < frame.scopes.size(); i++) {
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+		Scope scope = frame.scopes[i];
+		scope.gpuMs = end > begin ? double(end - begin) / 1e6 : 0.0;
+		if (scope.depth == 0) {
+			stats.gpuMs += scope.gpuMs;
+			stats.cpuMs += scope.cpuMs;
+		}
+		stats.scopes.push_back(std::move(scope));
+	}
+
+	m_last = std::move(stats);
+	frame.pending = false;
+	return true;
+}
+
+std::string GpuProfiler::summary() const {
+	std::string text = std::format("frame {}: gpu {:.3f} ms, cpu {:.3f} ms\n", m_last.frame, m_last.gpuMs, m_last.cpuMs);
+	for (const auto& scope : m_last.scopes) {
+		text += std::format("{}{}: gpu {:.3f} ms, cpu {:.3f} ms\n", std::string(scope.depth * 2 + 2, ' '), scope.name, scope.gpuMs, scope.cpuMs);
+	}
+	return text;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "glad/glad.h"
+
+#include <string>
+#include <string_view>
+#include <format>
+#include <vector>
+#include <chrono>
+
+/*
+ * GPU and CPU time of named scopes, per frame.
+ * Each scope writes a GL_TIMESTAMP query when it begins and one when it ends (timestamps can
+ * nest, unlike GL_TIME_ELAPSED). The queries of a frame are only read once the GPU has caught up,
+ * up to g_FrameLatency frames later, so measuring never waits for the GPU. A frame whose results
+ * are still not available when its queries are needed again is dropped.
+ * Needs nothing but a GL context (ARB_timer_query), so it works headless and on llvmpipe too.
+ */
+class GpuProfiler {
+public:
+	struct Scope {
+		std::string name;
+		uint32_t depth{ 0 }; // nesting level
+		double gpuMs{ 0.0 }, cpuMs{ 0.0 };
+	};
+
+	struct FrameStats {
+		uint64_t frame{ 0 };
+		double gpuMs{ 0.0 }, cpuMs{ 0.0 }; // of the top level scopes
+		std::vector<Scope> scopes; // in the order they began
+	};
+
+	// closes the scope when it goes out of scope
+	class ScopedTimer {
+	public:
+		explicit ScopedTimer(const char* name, GpuProfiler& profiler = GpuProfiler::shared()) : m_profiler(profiler) {
+			m_profiler.begin(name);
+		}
+
+		// named "name index", only formatted when the profiler is enabled
+		ScopedTimer(const char* name, size_t index, GpuProfiler& profiler = GpuProfiler::shared()) : m_profiler(profiler) {
+			if (m_profiler.enabled()) m_profiler.begin(std::format("{} {}", name, index));
+		}
+
+		~ScopedTimer() { m_profiler.end(); }
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	private:
+		GpuProfiler& m_profiler;
+	};
+
+	static constexpr size_t g_FrameLatency = 4;
+
+	GpuProfiler() = default;
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	// disabled profilers don't issue queries, scopes cost nothing
+	void setEnabled(bool enabled);
+	bool enabled() const { return m_enabled; }
+
+	// Ends the current frame, and collects the finished ones. Called once per frame on the GL thread
+	void beginFrame();
+
+	void begin(std::string_view name);
+	void end();
+
+	// latest frame the GPU is done with
+	const FrameStats& lastFrame() const { return m_last; }
+	size_t droppedFrames() const { return m_dropped; }
+
+	// lastFrame() as text, one indented line per scope
+	std::string summary() const;
+
+	static GpuProfiler& shared();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Frame {
+		uint64_t index{ 0 };
+		std::vector<GLuint> queries; // begin and end timestamp of each scope
+		std::vector<Scope> scopes;
+		GLuint last{ 0 }; // query issued last, the GPU writes the timestamps in order
+		bool pending{ false }; // results not read yet
+	};
+
+	struct OpenScope {
+		size_t index;
+		Clock::time_point start;
+	};
+
+	bool m_enabled{ false };
+	Frame m_frames[g_FrameLatency];
+	size_t m_current{ 0 };
+	uint64_t m_frameIndex{ 0 };
+	std::vector<OpenScope> m_open;
+
+	FrameStats m_last{};
+	size_t m_dropped{ 0 };
+
+	bool collect(Frame& frame);
+};
@@ -0,0 +1,252 @@
+#include "GraphInterpreter.h"
+#include "ShaderCache.h"
+
+#include <format>
+
+static const std::string interpreterUniforms = R"(struct Instruction {
+	uint op, dst, operands, aux;
+};
+
+layout (std430, binding=0) readonly buffer bInstructionBuffer { Instruction bInstructions[]; };
+layout (std430, binding=1) readonly buffer bOperandBuffer { uint bOperands[]; };
+layout (std430, binding=2) readonly buffer bConstantBuffer { vec4 bConstants[]; };
+uniform ivec2 bInstructionRange;
+)";
+
+static const std::string interpreterGlobals = R"(vec2 iUV;
+uint iTree;
+
+vec4 interp_tree(vec2 uv) {
+	ivec2 size = imageSize(bImages[iTree]);
+	return imageLoad(bImages[iTree], clamp(TileCoords(uv), ivec2(0), size - 1));
+}
+
+vec4 interp_fetch(uint code) {
+	uint index = code & 0x7FFFFFFu;
+	switch (code >> 30) {
+		case 0u: return iRegisters[index];
+		case 1u: return bConstants[index];
+	}
+	return vec4(iUV, 0.0, 1.0);
+}
+
+)";
+
+GraphInterpreter::~GraphInterpreter() {
+	for (GLuint buffer : { m_instructionBuffer, m_operandBuffer, m_constantBuffer }) {
+		if (buffer) glDeleteBuffers(1, &buffer);
+	}
+}
+
+uint32_t GraphInterpreter::opOf(GraphicsNode* node) const {
+	auto it = m_opIndex.find(typeid(*node));
+	return it == m_opIndex.end() ? g_StoreOp : it->second;
+}
+
+const ShaderFunction& GraphInterpreter::signature(uint32_t op) {
+	source();
+	return m_ops[op - 1].signature;
+}
+
+const std::string& GraphInterpreter::source() {
+	if (m_source.empty()) generate();
+	return m_source;
+}
+
+std::shared_ptr<Shader> GraphInterpreter::shader() {
+	if (!m_shader && !m_shaderFailed) {
+		m_shader = ShaderCache::shared().get(source());
+		m_shaderFailed = m_shader == nullptr;
+	}
+	return m_shader;
+}
+
+void GraphInterpreter::generate() {
+	ShaderGen gen{};
+
+	gen.target(ShaderGen::Target::uniforms) += interpreterUniforms;
+	gen.target(ShaderGen::Target::uniforms) += std::format("layout (rgba32f, binding=0) uniform image2D bImages[{}];\n", g_ImageCount);
+
+	gen.target(ShaderGen::Target::definitions) += std::format("vec4 iRegisters[{}];\n", g_RegisterCount);
+	gen.target(ShaderGen::Target::definitions) += interpreterGlobals;
+
+	// vec4 -> parameter type, for each type the value had before it was stored
+	static const char* raw[] = { "", "raw.x", "raw.xy", "raw.xyz", "raw" };
+	for (auto to : { ValueType::scalar, ValueType::vec2, ValueType::vec3, ValueType::vec4 }) {
+		const auto& typeName = typeStr[size_t(to)];
+
+		gen.beginFunctionBlock(std::format("{} interp_as_{}(vec4 raw, uint type)", typeName, typeName));
+		gen.indent();
+		gen.append("switch (type) {\n");
+		for (auto from : { ValueType::scalar, ValueType::vec2, ValueType::vec3 }) {
+			gen.indent();
+			gen.append(std::format("\tcase {}u: return ", size_t(from)));
+			gen.convertType(from, to, raw[size_t(from)]);
+			gen.append(";\n");
+		}
+		gen.indent();
+		gen.append("}\n");
+		gen.indent();
+		gen.append("return ");
+		gen.convertType(ValueType::vec4, to, "raw");
+		gen.append(";\n");
+		gen.endFunctionBlock(ShaderGen::Target::definitions);
+		gen.target(ShaderGen::Target::definitions) += "\n";
+	}
+
+	gen.target(ShaderGen::Target::definitions) += std::format(R"(
+vec4 interp_load(uint at) {{
+	uint code = bOperands[at];
+	if ((code >> 30) != 3u) return interp_fetch(code);
+
+	uint image = code & 0x{:X}u;
+	uint uvCode = bOperands[at + 1u];
+	vec2 uv = interp_as_vec2(interp_fetch(uvCode), (uvCode >> 27) & 7u);
+	if ((code & 0x{:X}u) != 0u) {{
+		ivec2 size = imageSize(bImages[image]);
+		return imageLoad(bImages[image], clamp(TileCoords(uv), ivec2(0), size - 1));
+	}}
+	return Tex(bImages[image], uv);
+}}
+
+)", g_TileImageBit - 1, g_TileImageBit);
+
+	for (auto type : { ValueType::scalar, ValueType::vec2, ValueType::vec3, ValueType::vec4 }) {
+		const auto& typeName = typeStr[size_t(type)];
+		gen.target(ShaderGen::Target::definitions) += std::format(
+			"{} interp_operand_{}(uint at) {{ return interp_as_{}(interp_load(at), (bOperands[at] >> 27) & 7u); }}\n",
+			typeName, typeName, typeName
+		);
+	}
+	gen.target(ShaderGen::Target::definitions) += "\n";
+
+	// every node function, $NODE is the op and $TREE samples the image of the instruction
+	for (size_t i = 0; i < m_ops.size(); i++) {
+		auto& op = m_ops[i];
+		const size_t index = i + 1;
+
+		gen.loadLib(op.prototype->libraryTemplate(), index, "interp_tree");
+		op.function = op.prototype->functionNameTemplate().fill(index);
+		gen.pasteFunction(op.function);
+		op.signature = gen.getFunction(op.function);
+	}
+
+	gen.beginFunctionBlock("void interpret()");
+	gen.indent();
+	gen.append("for (int pc = bInstructionRange.x; pc < bInstructionRange.y; pc++) {\n");
+	gen.indent();
+	gen.append("\tInstruction inst = bInstructions[pc];\n");
+	gen.indent();
+	gen.append("\tuint at = inst.operands;\n");
+	gen.indent();
+	gen.append("\tiTree = inst.aux;\n\n");
+	gen.indent();
+	gen.append("\tswitch (inst.op) {\n");
+
+	gen.indent();
+	gen.append(std::format("\t\tcase {}u: {{\n", g_StoreOp));
+	gen.indent();
+	gen.append("\t\t\timageStore(bImages[inst.aux], TileCoords(iUV), interp_operand_vec4(at));\n");
+	gen.indent();
+	gen.append("\t\t} break;\n");
+
+	for (size_t i = 0; i < m_ops.size(); i++) {
+		const auto& op = m_ops[i];
+		const auto& fn = op.signature;
+
+		gen.indent();
+		gen.append(std::format("\t\tcase {}u: {{\n", i + 1));
+
+		std::vector<ValueType> outputs;
+		for (const auto& param : fn.parameterOrder) {
+			auto& paramOb = fn.parameters.at(param);
+			if (paramOb.qualifier != ShaderFunctionParam::out) continue;
+
+			gen.indent();
+			gen.append(std::format("\t\t\t{} out{};\n", typeStr[size_t(paramOb.type)], outputs.size()));
+			outputs.push_back(paramOb.type);
+		}
+
+		// inputs in the order TextureNodeGraph::emitNodeCall passes them, then the outputs
+		std::vector<std::string> args;
+		for (const auto& param : fn.parameterOrder) {
+			auto& paramOb = fn.parameters.at(param);
+			if (paramOb.qualifier == ShaderFunctionParam::out) continue;
+			args.push_back(std::format("interp_operand_{}(at + {}u)", typeStr[size_t(paramOb.type)], args.size() * g_OperandWords));
+		}
+		for (size_t j = 0; j < outputs.size(); j++) {
+			args.push_back(std::format("out{}", j));
+		}
+
+		gen.indent();
+		gen.append(std::format("\t\t\t{}(", op.function));
+		for (size_t j = 0; j < args.size(); j++) {
+			gen.append(j > 0 ? ", " + args[j] : args[j]);
+		}
+		gen.append(");\n");
+
+		for (size_t j = 0; j < outputs.size(); j++) {
+			gen.indent();
+			gen.append(std::format("\t\t\tiRegisters[inst.dst + {}u] = ", j));
+			gen.convertType(outputs[j], ValueType::vec4, std::format("out{}", j));
+			gen.append(";\n");
+		}
+
+		gen.indent();
+		gen.append("\t\t} break;\n");
+	}
+
+	gen.indent();
+	gen.append("\t}\n");
+	gen.indent();
+	gen.append("}\n");
+	gen.endFunctionBlock(ShaderGen::Target::definitions);
+
+	gen.target(ShaderGen::Target::body) += "\tif (any(greaterThanEqual(cCoords, ivec2(bOutputSize)))) return;\n";
+	gen.target(ShaderGen::Target::body) += "\tiUV = cUV;\n";
+	gen.target(ShaderGen::Target::body) += "\tinterpret();";
+
+	m_source = gen.generate();
+}
+
+void GraphInterpreter::uploadBuffer(GLuint& buffer, const void* data, size_t size) {
+	if (!buffer) {
+		glGenBuffers(1, &buffer);
+	}
+
+	// runtime sized arrays can't be bound to an empty buffer
+	static const uint32_t empty[4] = { 0 };
+	if (size == 0) {
+		data = empty;
+		size = sizeof(empty);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GraphInterpreter::upload(const Program& program) {
+	uploadBuffer(m_instructionBuffer, program.instructions.data(), program.instructions.size() * sizeof(Instruction));
+	uploadBuffer(m_operandBuffer, program.operands.data(), program.operands.size() * sizeof(uint32_t));
+	m_passes = program.passes;
+}
+
+// constants[0] has to be zero, it is read by unconnected inputs without a param
+void GraphInterpreter::uploadConstants(const std::vector<RawValue>& constants) {
+	uploadBuffer(m_constantBuffer, constants.data(), constants.size() * sizeof(RawValue));
+}
+
+void GraphInterpreter::dispatch(Shader& shader, uint32_t width, uint32_t height) {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instructionBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_operandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_constantBuffer);
+
+	const WorkGroupSize size{};
+	for (const auto& [begin, end] : m_passes) {
+		shader.uniformInt<2>("bInstructionRange", { int(begin), int(end) });
+
+		glDispatchCompute((width + size.x - 1) / size.x, (height + size.y - 1) / size.y, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "GraphicsNode.h"
+#include "ShaderGen.h"
+#include "Shader.h"
+
+#include <vector>
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+
+/*
+ * UBER SHADER INTERPRETER
+ * ====================================================
+ * One compute shader containing the function of every registered node type, generated and compiled
+ * once. A graph is turned into a Program (see TextureNodeGraph::buildProgram) that the shader runs
+ * per pixel: each instruction calls one node function, reading its inputs through operands and
+ * writing its outputs to registers. Editing the topology then only re-uploads a few buffers, where
+ * the fused codegen path has to compile a new program.
+ *
+ * Values are kept as vec4 the way generated code converts them (see ShaderGen::convertType),
+ * and converted back to the type of the function parameter when read.
+ */
+class GraphInterpreter {
+public:
+	// matches the GLSL struct (std430)
+	struct Instruction {
+		uint32_t op{ 0 };
+		uint32_t dst{ 0 }; // first output register
+		uint32_t operands{ 0 }; // offset in the operand buffer, g_OperandWords per function parameter
+		uint32_t aux{ 0 }; // image sampled by $TREE, or written by g_StoreOp
+	};
+
+	enum class OperandKind : uint32_t {
+		reg = 0,
+		constant, // param value, see uploadConstants
+		uv, // cUV
+		image // image index, the next word is the uv operand it is sampled at
+	};
+
+	// Set in the index of an image operand reading an intermediate. Those only hold the current tile
+	// (see TextureNodeGraph::renderTiled), so they are loaded at the tile coordinates of uv instead of
+	// sampled across the whole texture like Image params.
+	static constexpr uint32_t g_TileImageBit = 1u << 26;
+
+	struct Program {
+		std::vector<Instruction> instructions;
+		std::vector<uint32_t> operands;
+		std::vector<std::pair<uint32_t, uint32_t>> passes; // instruction ranges, one dispatch each
+	};
+
+	static constexpr uint32_t g_StoreOp = 0; // stores its operand to image aux, node types follow
+	static constexpr uint32_t g_OperandWords = 2;
+	static constexpr uint32_t g_RegisterCount = 16;
+	static constexpr uint32_t g_ImageCount = 8;
+	static constexpr uint32_t g_MaxOperandIndex = (1u << 27) - 1;
+
+	static uint32_t operand(OperandKind kind, ValueType type, uint32_t index) {
+		return (uint32_t(kind) << 30) | (uint32_t(type) << 27) | index;
+	}
+
+	GraphInterpreter() = default;
+	~GraphInterpreter();
+
+	GraphInterpreter(const GraphInterpreter&) = delete;
+	GraphInterpreter& operator=(const GraphInterpreter&) = delete;
+
+	template <typename T>
+	void registerNodeType() {
+		auto prototype = std::make_unique<T>();
+		prototype->setup();
+
+		m_opIndex[typeid(T)] = uint32_t(m_ops.size()) + 1;
+		m_ops.push_back({ .prototype = std::move(prototype) });
+
+		m_source.clear();
+		m_shader.reset();
+	}
+
+	// 0 (g_StoreOp) when the node type wasn't registered
+	uint32_t opOf(GraphicsNode* node) const;
+	const ShaderFunction& signature(uint32_t op);
+
+	const std::string& source();
+
+	// compiled on first use, nullptr if it failed
+	std::shared_ptr<Shader> shader();
+
+	void upload(const Program& program);
+	void uploadConstants(const std::vector<RawValue>& constants);
+
+	// runs every pass of the uploaded program, the images are bound by the caller
+	void dispatch(Shader& shader, uint32_t width, uint32_t height);
+
+private:
+	struct Op {
+		std::unique_ptr<GraphicsNode> prototype;
+		std::string function;
+		ShaderFunction signature;
+	};
+
+	std::vector<Op> m_ops; // m_ops[op - 1]
+	std::unordered_map<std::type_index, uint32_t> m_opIndex;
+
+	std::string m_source;
+	std::shared_ptr<Shader> m_shader;
+	bool m_shaderFailed{ false };
+
+	std::vector<std::pair<uint32_t, uint32_t>> m_passes;
+	GLuint m_instructionBuffer{ 0 }, m_operandBuffer{ 0 }, m_constantBuffer{ 0 };
+
+	void generate();
+	static void uploadBuffer(GLuint& buffer, const void* data, size_t size);
+};
@@ -7,6 +7,8 @@
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <typeindex>
+#include <unordered_map>
 
 // From https://helloacm.com/convert-a-string-to-camel-case-format-in-c/#:~:text=How%20to%20Convert%20a%20String%20into%20Camel%20Case%20in%20C%2B%2B%3F&text=function,end()%2C%20data.
 std::string toCamelCase(const std::string& text) {
@@ -37,6 +39,29 @@ std::string toCamelCase(const std::string& text) {
 	return ans;
 }
 
+struct NodeTypeTemplates {
+	SourceTemplate library, functionName;
+};
+
+static NodeTypeTemplates& templatesFor(GraphicsNode* node) {
+	static std::unordered_map<std::type_index, NodeTypeTemplates> g_TypeTemplates;
+
+	auto [it, inserted] = g_TypeTemplates.try_emplace(typeid(*node));
+	if (inserted) {
+		it->second.library = SourceTemplate(node->library());
+		it->second.functionName = SourceTemplate(node->functionName());
+	}
+	return it->second;
+}
+
+const SourceTemplate& GraphicsNode::libraryTemplate() {
+	return templatesFor(this).library;
+}
+
+const SourceTemplate& GraphicsNode::functionNameTemplate() {
+	return templatesFor(this).functionName;
+}
+
 void GraphicsNode::addParam(const std::string& name, ValueType type) {
 	m_params[name] = {
 		.value = RawValue(),
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "NodeGraph.h"
+#include "SourceTemplate.h"
 
 #include "olcUTIL_DataFile.h"
 
@@ -25,9 +26,20 @@ public:
 	virtual std::string functionName() = 0;
 	virtual std::string library() = 0;
 	virtual bool multiPassNode() { return false; }
+	// Kernel nodes sample their $TREE within this many texels of the current one.
+	// Their source is then loaded once per workgroup into shared memory (see TextureNodeGraph::generate).
+	virtual uint32_t kernelRadius() { return 0; }
 	virtual GraphicsNodeParams parameters() = 0;
+
+	// library() and functionName() tokenized once per node type
+	const SourceTemplate& libraryTemplate();
+	const SourceTemplate& functionNameTemplate();
 	virtual bool render(uint32_t width, uint32_t height, size_t binding = 0) { return false; }
 
+	// rough per pixel cost estimates, used to decide which nodes get their own pass (see TextureNodeGraph::planPasses)
+	virtual float aluCost() { return 1.0f; }
+	virtual float sampleCount() { return 0.0f; } // image reads
+
 	virtual void onCreate() = 0;
 
 	void setup() override final;
@@ -38,31 +50,27 @@ public:
 	const NodeValue& param(const std::string& name) { return m_params[name]; }
 	RawValue& paramValue(const std::string& name) { return m_params[name].value; }
 
-	void setParam(const std::string& name, const RawValue& value) { m_params[name].value = value; m_changed = true; }
-	void setParam(const std::string& name, float v) { m_params[name].value[0] = v; m_changed = true; }
+	void setParam(const std::string& name, const RawValue& value) { m_params[name].value = value; markChanged(); }
+	void setParam(const std::string& name, float v) { m_params[name].value[0] = v; markChanged(); }
 	void setParam(const std::string& name, float x, float y) {
 		m_params[name].value[0] = x;
 		m_params[name].value[1] = y;
-		m_changed = true;
+		markChanged();
 	}
 	void setParam(const std::string& name, float x, float y, float z) {
 		m_params[name].value[0] = x;
 		m_params[name].value[1] = y;
 		m_params[name].value[2] = z;
-		m_changed = true;
+		markChanged();
 	}
 	void setParam(const std::string& name, float x, float y, float z, float w) {
 		m_params[name].value[0] = x;
 		m_params[name].value[1] = y;
 		m_params[name].value[2] = z;
 		m_params[name].value[3] = w;
-		m_changed = true;
-	}
-	void setParam(const std::string& name, size_t index, float v) { m_params[name].value[index] = v; m_changed = true; }
-
-	void markChanged() {
-		m_changed = true;
+		markChanged();
 	}
+	void setParam(const std::string& name, size_t index, float v) { m_params[name].value[index] = v; markChanged(); }
 
 	bool hasParam(const std::string& name) { return m_params.find(name) != m_params.end(); }
 
@@ -79,10 +87,8 @@ public:
 		}
 	}
 
+	// the saved id is restored by NodeGraph::setNodeId, which keeps the id index in sync
 	virtual void loadFrom(olc::utils::datafile& df) {
-		m_id = df["id"].GetInt();
-		NodeGraph::g_NodeID = std::max(m_id, NodeGraph::g_NodeID);
-
 		for (auto& [pName, pData] : m_params) {
 			auto& prop = df[toCamelCase(pName)];
 			pData.value = {
@@ -97,7 +97,8 @@ struct Icon {
 enum Icons {
 	icoClose = 1,
 	icoFolderOpen,
-	icoSave
+	icoSave,
+	icoExport
 };
 
 // use this tool to fix the icons https://yqnn.github.io/svg-path-editor/
@@ -105,5 +106,6 @@ inline static Icon icons[] = {
 	{ 0, 0, "" },
 	{ 24, 24, "M19,6.41L17.59,5L12,10.59L6.41,5L5,6.41L10.59,12L5,17.59L6.41,19L12,13.41L17.59,19L19,17.59L13.41,12L19,6.41Z" },
 	{ 24, 24, "M 19 20 L 4 20 C 2.89 20 2 19.1 2 18 L 2 6 C 2 4.89 2.89 4 4 4 L 10 4 L 12 6 L 19 6 C 19.6667 6.6667 20.3333 7.3333 21 8 L 21 8 L 4 8 L 4 18 L 6.14 10 L 23.21 10 L 20.93 18.5 C 20.7 19.37 19.92 20 19 20 Z" },
-	{ 24, 24, "M 15 9 L 5 9 L 5 5 L 15 5 M 12 19 C 10.4 19 9 17.5 9 16 C 9 14.4 10.4 13 12 13 C 13.6 13 15 14.4 15 16 C 15 17.6 13.6 19 12 19 M 17 3 L 5 3 C 3.89 3 3 3.9 3 5 L 3 19 C 3 20 4 21 5 21 L 19 21 C 20 21 21 20 21 19 L 21 7 L 17 3 K Z" }
+	{ 24, 24, "M 15 9 L 5 9 L 5 5 L 15 5 M 12 19 C 10.4 19 9 17.5 9 16 C 9 14.4 10.4 13 12 13 C 13.6 13 15 14.4 15 16 C 15 17.6 13.6 19 12 19 M 17 3 L 5 3 C 3.89 3 3 3.9 3 5 L 3 19 C 3 20 4 21 5 21 L 19 21 C 20 21 21 20 21 19 L 21 7 L 17 3 K Z" },
+	{ 24, 24, "M 23 12 L 19 8 L 19 11 L 10 11 L 10 13 L 19 13 L 19 16 L 23 12 Z M 1 18 L 1 6 C 1 4.89 1.9 4 3 4 L 15 4 C 16.1 4 17 4.9 17 6 L 17 9 L 15 9 L 15 6 L 3 6 L 3 18 L 15 18 L 15 15 L 17 15 L 17 18 C 17 19.1 16.1 20 15 20 L 3 20 C 1.9 20 1 19.1 1 18 Z" }
 };
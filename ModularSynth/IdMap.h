@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+/*
+ * Dense id -> object index.
+ * Ids are small increasing integers, so they are used directly as slot indices.
+ * Ids above g_MaxId are rejected, they can come from files and would size the table.
+ * Every time a slot is emptied its generation is bumped, so a Handle taken before
+ * a removal no longer resolves, even if another object is later stored under the same id.
+ */
+template <typename T>
+class IdMap {
+public:
+	struct Handle {
+		size_t id{ 0 };
+		uint32_t generation{ 0 };
+	};
+
+	static constexpr size_t g_MaxId = (size_t(1) << 24) - 1;
+
+	// false if the id is out of range
+	bool insert(size_t id, T* value) {
+		if (id > g_MaxId) return false;
+		if (id >= m_slots.size()) {
+			m_slots.resize(id + 1);
+		}
+		assert(m_slots[id].value == nullptr);
+		m_slots[id].value = value;
+		return true;
+	}
+
+	void erase(size_t id) {
+		if (id >= m_slots.size() || m_slots[id].value == nullptr) return;
+		m_slots[id].value = nullptr;
+		m_slots[id].generation++;
+	}
+
+	T* get(size_t id) const {
+		return id < m_slots.size() ? m_slots[id].value : nullptr;
+	}
+
+	T* get(const Handle& handle) const {
+		if (handle.id >= m_slots.size()) return nullptr;
+		const Slot& slot = m_slots[handle.id];
+		return slot.generation == handle.generation ? slot.value : nullptr;
+	}
+
+	Handle handle(size_t id) const {
+		if (id >= m_slots.size()) return { id, 0 };
+		return { id, m_slots[id].generation };
+	}
+
+	bool contains(size_t id) const { return get(id) != nullptr; }
+
+private:
+	struct Slot {
+		T* value{ nullptr };
+		uint32_t generation{ 0 };
+	};
+
+	std::vector<Slot> m_slots;
+};
@@ -0,0 +1,427 @@
+#include "ImageExporter.h"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <array>
+
+ImageExporter::ImageExporter(size_t ringSize, size_t bufferBytes) {
+	m_bufferBytes = bufferBytes;
+
+	for (size_t i = 0; i < std::max<size_t>(ringSize, 1); i++) {
+		auto slot = std::make_unique<Slot>();
+
+		// persistent and coherent, the workers read the pixels straight from the mapping
+		const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &slot->buffer);
+		glNamedBufferStorage(slot->buffer, GLsizeiptr(bufferBytes), nullptr, flags);
+		slot->mapped = static_cast<uint8_t*>(glMapNamedBufferRange(slot->buffer, 0, GLsizeiptr(bufferBytes), flags));
+
+		m_ring.push_back(std::move(slot));
+	}
+}
+
+ImageExporter::~ImageExporter() {
+	finish();
+
+	for (auto& slot : m_ring) {
+		glUnmapNamedBuffer(slot->buffer);
+		glDeleteBuffers(1, &slot->buffer);
+	}
+}
+
+size_t ImageExporter::begin(const std::string& path, Format format, uint32_t width, uint32_t height, uint32_t channels) {
+	auto image = std::make_shared<Image>();
+	image->path = path;
+	image->format = format;
+	image->width = width;
+	image->height = height;
+	image->channels = channels == 1 ? 1 : 4;
+	image->pixels.resize(size_t(width) * height * image->channels * sampleBytes(format));
+	image->remaining = size_t(width) * height;
+
+	m_images.push_back(image);
+	return m_images.size() - 1;
+}
+
+void ImageExporter::read(
+	size_t index,
+	const Texture& texture,
+	uint32_t srcX, uint32_t srcY,
+	uint32_t dstX, uint32_t dstY,
+	uint32_t width, uint32_t height
+) {
+	if (index >= m_images.size() || !m_images[index]) return;
+	auto image = m_images[index];
+
+	GLenum type = GL_UNSIGNED_BYTE;
+	switch (image->format) {
+		case Format::png8: type = GL_UNSIGNED_BYTE; break;
+		case Format::png16: type = GL_UNSIGNED_SHORT; break;
+		case Format::exr: type = GL_HALF_FLOAT; break;
+	}
+	const GLenum format = image->channels == 1 ? GL_RED : GL_RGBA;
+
+	// bands of rows that fit in one buffer
+	const size_t rowBytes = size_t(width) * image->channels * sampleBytes(image->format);
+	const uint32_t bandRows = uint32_t(std::max<size_t>(m_bufferBytes / std::max<size_t>(rowBytes, 1), 1));
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (uint32_t row = 0; row < height; row += bandRows) {
+		const uint32_t rows = std::min(bandRows, height - row);
+		Slot& slot = acquireSlot();
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glGetTextureSubImage(
+			texture.id(), 0,
+			GLint(srcX), GLint(srcY + row), 0,
+			GLsizei(width), GLsizei(rows), 1,
+			format, type, GLsizei(m_bufferBytes), nullptr
+		);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.image = image;
+		slot.x = dstX;
+		slot.y = dstY + row;
+		slot.width = width;
+		slot.height = rows;
+		m_readbacks++;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	// fully queued, the slots and the tasks keep it alive until it's written
+	image->queued += size_t(width) * height;
+	if (image->queued >= size_t(image->width) * image->height) {
+		m_images[index].reset();
+
+		// the indices past the last image still being read are free again
+		while (!m_images.empty() && !m_images.back()) {
+			m_images.pop_back();
+		}
+	}
+}
+
+void ImageExporter::cancel(size_t index) {
+	if (index >= m_images.size()) return;
+
+	// readbacks already queued still complete, the image never gets all its pixels and is released with them
+	m_images[index].reset();
+	while (!m_images.empty() && !m_images.back()) {
+		m_images.pop_back();
+	}
+}
+
+void ImageExporter::exportTexture(const Texture& texture, const std::string& path, Format format) {
+	const auto& size = texture.size();
+	const GLenum internalFormat = texture.internalFormat();
+	const uint32_t channels = (internalFormat == GL_R8 || internalFormat == GL_R16F || internalFormat == GL_R32F) ? 1 : 4;
+
+	size_t image = begin(path, format, size[0], size[1], channels);
+	read(image, texture, 0, 0, 0, 0, size[0], size[1]);
+}
+
+ImageExporter::Slot& ImageExporter::acquireSlot() {
+	Slot& slot = *m_ring[m_next];
+	m_next = (m_next + 1) % m_ring.size();
+
+	if (slot.fence) {
+		// the whole ring is in flight, wait for the oldest readback
+		m_stalls++;
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		complete(slot);
+	}
+	while (slot.copying) {
+		std::this_thread::yield();
+	}
+	return slot;
+}
+
+void ImageExporter::poll() {
+	for (auto& slot : m_ring) {
+		if (!slot->fence) continue;
+
+		GLenum status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			complete(*slot);
+		}
+	}
+}
+
+void ImageExporter::finish() {
+	for (auto& slot : m_ring) {
+		if (!slot->fence) continue;
+
+		glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		complete(*slot);
+	}
+	ThreadPool::shared().wait(m_tasks);
+}
+
+ImageExporter::Stats ImageExporter::stats() const {
+	return {
+		.readbacks = m_readbacks,
+		.stalls = m_stalls,
+		.written = m_written,
+		.failed = m_failed
+	};
+}
+
+// the buffer is done on the GPU side, the copy and the encoding happen on a worker
+void ImageExporter::complete(Slot& slot) {
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	slot.copying = true;
+
+	auto image = std::move(slot.image);
+	const uint32_t x = slot.x, y = slot.y, width = slot.width, height = slot.height;
+
+	ThreadPool::shared().submit([this, &slot, image, x, y, width, height]() {
+		const size_t texelBytes = image->channels * sampleBytes(image->format);
+		const size_t rowBytes = size_t(width) * texelBytes;
+		for (uint32_t row = 0; row < height; row++) {
+			std::memcpy(
+				image->pixels.data() + ((size_t(y) + row) * image->width + x) * texelBytes,
+				slot.mapped + row * rowBytes,
+				rowBytes
+			);
+		}
+		slot.copying = false;
+
+		// the last band encodes the image
+		const size_t count = size_t(width) * height;
+		if (image->remaining.fetch_sub(count) == count) {
+			if (encode(*image)) m_written++;
+			else m_failed++;
+
+			// the tasks of the other bands may hold on to the image a little longer
+			image->pixels.clear();
+			image->pixels.shrink_to_fit();
+		}
+	}, &m_tasks);
+}
+
+size_t ImageExporter::sampleBytes(Format format) {
+	return format == Format::png8 ? 1 : 2;
+}
+
+bool ImageExporter::encode(const Image& image) {
+	switch (image.format) {
+		case Format::png8:
+		case Format::png16: return writePng(image);
+		case Format::exr: return writeExr(image);
+	}
+	return false;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+	static const auto table = []() {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void putU32BE(std::vector<uint8_t>& out, uint32_t v) {
+	out.insert(out.end(), { uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v) });
+}
+
+static void writePngChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> head;
+	putU32BE(head, uint32_t(data.size()));
+	head.insert(head.end(), type, type + 4);
+
+	uint32_t crc = crc32(0, head.data() + 4, 4);
+	crc = crc32(crc, data.data(), data.size());
+
+	std::vector<uint8_t> tail;
+	putU32BE(tail, crc);
+
+	file.write(reinterpret_cast<const char*>(head.data()), head.size());
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.write(reinterpret_cast<const char*>(tail.data()), tail.size());
+}
+
+// Uncompressed (stored deflate blocks), the export is bound by encoding speed, not file size
+bool ImageExporter::writePng(const Image& image) {
+	std::ofstream file(image.path, std::ios::binary);
+	if (!file) return false;
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	const size_t sample = sampleBytes(image.format);
+	std::vector<uint8_t> header;
+	putU32BE(header, image.width);
+	putU32BE(header, image.height);
+	header.push_back(uint8_t(sample * 8));
+	header.push_back(image.channels == 1 ? 0 : 6); // gray / RGBA
+	header.insert(header.end(), { 0, 0, 0 });
+	writePngChunk(file, "IHDR", header);
+
+	constexpr size_t chunkSize = 1024 * 1024;
+	constexpr size_t blockSize = 65535;
+
+	const size_t rowBytes = size_t(image.width) * image.channels * sample;
+	size_t remaining = (rowBytes + 1) * image.height; // with the filter byte of each row
+	size_t blockLeft = 0;
+	uint32_t adlerA = 1, adlerB = 0;
+
+	std::vector<uint8_t> idat = { 0x78, 0x01 }; // zlib header, no compression
+	idat.reserve(chunkSize + blockSize);
+
+	auto put = [&](const uint8_t* data, size_t size) {
+		while (size > 0) {
+			if (blockLeft == 0) {
+				blockLeft = std::min(remaining, blockSize);
+				const uint16_t len = uint16_t(blockLeft);
+				idat.insert(idat.end(), {
+					uint8_t(blockLeft == remaining ? 1 : 0),
+					uint8_t(len), uint8_t(len >> 8),
+					uint8_t(~len), uint8_t(uint16_t(~len) >> 8)
+				});
+			}
+
+			const size_t n = std::min(size, blockLeft);
+			for (size_t i = 0; i < n; i++) {
+				adlerA = (adlerA + data[i]) % 65521;
+				adlerB = (adlerB + adlerA) % 65521;
+			}
+			idat.insert(idat.end(), data, data + n);
+
+			data += n;
+			size -= n;
+			blockLeft -= n;
+			remaining -= n;
+
+			if (idat.size() >= chunkSize) {
+				writePngChunk(file, "IDAT", idat);
+				idat.clear();
+			}
+		}
+	};
+
+	std::vector<uint8_t> row(rowBytes + 1, 0); // filter type 0
+	for (uint32_t y = 0; y < image.height; y++) {
+		const uint8_t* src = image.pixels.data() + y * rowBytes;
+		if (sample == 2) {
+			// PNG samples are big endian
+			for (size_t i = 0; i < rowBytes; i += 2) {
+				row[1 + i] = src[i + 1];
+				row[2 + i] = src[i];
+			}
+		}
+		else {
+			std::memcpy(row.data() + 1, src, rowBytes);
+		}
+		put(row.data(), row.size());
+	}
+
+	putU32BE(idat, (adlerB << 16) | adlerA);
+	writePngChunk(file, "IDAT", idat);
+	writePngChunk(file, "IEND", {});
+
+	return bool(file);
+}
+
+// Scanline file, one line per block, no compression, half channels
+bool ImageExporter::writeExr(const Image& image) {
+	std::ofstream file(image.path, std::ios::binary);
+	if (!file) return false;
+
+	std::vector<uint8_t> out;
+	auto putBytes = [&](const void* data, size_t size) {
+		auto bytes = static_cast<const uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	};
+	auto putI32 = [&](int32_t v) { putBytes(&v, 4); }; // little endian, like the file
+	auto putString = [&](const std::string& str) { putBytes(str.c_str(), str.size() + 1); };
+	auto attribute = [&](const std::string& name, const std::string& type, int32_t size) {
+		putString(name);
+		putString(type);
+		putI32(size);
+	};
+
+	putI32(20000630); // magic
+	putI32(2); // version, scanline
+
+	// channels in alphabetical order, with the RGBA sample they come from
+	std::vector<std::pair<std::string, size_t>> channels;
+	if (image.channels == 1) channels = { { "Y", 0 } };
+	else channels = { { "A", 3 }, { "B", 2 }, { "G", 1 }, { "R", 0 } };
+
+	int32_t chlistSize = 1;
+	for (const auto& [name, sample] : channels) chlistSize += int32_t(name.size() + 1 + 16);
+
+	attribute("channels", "chlist", chlistSize);
+	for (const auto& [name, sample] : channels) {
+		putString(name);
+		putI32(1); // HALF
+		putBytes("\0\0\0\0", 4); // pLinear, reserved
+		putI32(1); // x sampling
+		putI32(1); // y sampling
+	}
+	out.push_back(0);
+
+	const int32_t maxX = int32_t(image.width) - 1, maxY = int32_t(image.height) - 1;
+	const float one = 1.0f, zero[2] = { 0.0f, 0.0f };
+
+	attribute("compression", "compression", 1);
+	out.push_back(0); // NO_COMPRESSION
+	attribute("dataWindow", "box2i", 16);
+	for (int32_t v : { 0, 0, maxX, maxY }) putI32(v);
+	attribute("displayWindow", "box2i", 16);
+	for (int32_t v : { 0, 0, maxX, maxY }) putI32(v);
+	attribute("lineOrder", "lineOrder", 1);
+	out.push_back(0); // INCREASING_Y
+	attribute("pixelAspectRatio", "float", 4);
+	putBytes(&one, 4);
+	attribute("screenWindowCenter", "v2f", 8);
+	putBytes(zero, 8);
+	attribute("screenWindowWidth", "float", 4);
+	putBytes(&one, 4);
+	out.push_back(0); // end of header
+
+	// line offset table
+	const size_t lineBytes = size_t(image.width) * channels.size() * 2;
+	uint64_t offset = out.size() + size_t(image.height) * 8;
+	for (uint32_t y = 0; y < image.height; y++) {
+		putBytes(&offset, 8);
+		offset += 8 + lineBytes;
+	}
+	file.write(reinterpret_cast<const char*>(out.data()), out.size());
+
+	// lines, the channels one after the other
+	std::vector<uint8_t> line(8 + lineBytes);
+	const int32_t dataSize = int32_t(lineBytes);
+	for (uint32_t y = 0; y < image.height; y++) {
+		const int32_t ly = int32_t(y);
+		std::memcpy(line.data(), &ly, 4);
+		std::memcpy(line.data() + 4, &dataSize, 4);
+
+		const uint16_t* src = reinterpret_cast<const uint16_t*>(image.pixels.data()) + size_t(y) * image.width * image.channels;
+		uint8_t* dst = line.data() + 8;
+		for (const auto& [name, sample] : channels) {
+			for (uint32_t x = 0; x < image.width; x++) {
+				std::memcpy(dst, &src[x * image.channels + sample], 2);
+				dst += 2;
+			}
+		}
+		file.write(reinterpret_cast<const char*>(line.data()), line.size());
+	}
+
+	return bool(file);
+}
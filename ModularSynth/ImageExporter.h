@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Texture.h"
+#include "ThreadPool.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+/*
+ * Writes textures to image files without stalling the GL thread.
+ * Readbacks go through a ring of persistently mapped pixel pack buffers: read() copies a texture
+ * region into the next buffer and fences it, poll() picks up the buffers the GPU is done with.
+ * Their rows are copied into the image and, once every pixel of an image has arrived, it is encoded
+ * and written on ThreadPool workers while the GL thread renders the next one. The tasks form their own
+ * group, other users of the pool don't wait for them. A buffer only has to be
+ * waited for when the whole ring is still in flight (counted in Stats::stalls).
+ */
+class ImageExporter {
+public:
+	enum class Format : uint8_t {
+		png8 = 0,
+		png16,
+		exr // half float
+	};
+
+	struct Stats {
+		size_t readbacks{ 0 }, stalls{ 0 };
+		size_t written{ 0 }, failed{ 0 };
+	};
+
+	static constexpr size_t g_DefaultRingSize = 4;
+	static constexpr size_t g_DefaultBufferBytes = 32 * 1024 * 1024;
+
+	explicit ImageExporter(size_t ringSize = g_DefaultRingSize, size_t bufferBytes = g_DefaultBufferBytes);
+	~ImageExporter(); // finishes the queued images
+
+	ImageExporter(const ImageExporter&) = delete;
+	ImageExporter& operator=(const ImageExporter&) = delete;
+
+	// Starts a width x height image, 1 (gray) or 4 (RGBA) channels. Written to path once read() has covered it.
+	size_t begin(const std::string& path, Format format, uint32_t width, uint32_t height, uint32_t channels = 4);
+
+	// Queues the readback of a texture region to (dstX, dstY) of the image
+	void read(
+		size_t image,
+		const Texture& texture,
+		uint32_t srcX, uint32_t srcY,
+		uint32_t dstX, uint32_t dstY,
+		uint32_t width, uint32_t height
+	);
+
+	// Drops an image begin() started that won't be fully read (a failed render), nothing is written for it
+	void cancel(size_t image);
+
+	// the whole texture as a file, channels follow its format
+	void exportTexture(const Texture& texture, const std::string& path, Format format);
+
+	// Hands the finished readbacks to the workers, called every frame on the GL thread
+	void poll();
+
+	// Blocks until every queued image is written
+	void finish();
+
+	Stats stats() const;
+
+private:
+	struct Image {
+		std::string path;
+		Format format{ Format::png8 };
+		uint32_t width{ 0 }, height{ 0 }, channels{ 4 };
+		std::vector<uint8_t> pixels; // rows top to bottom, samples in the type read back for format
+		std::atomic<size_t> remaining{ 0 }; // pixels not read back yet
+		size_t queued{ 0 }; // pixels read() was called for, GL thread only
+	};
+
+	struct Slot {
+		GLuint buffer{ 0 };
+		uint8_t* mapped{ nullptr };
+		GLsync fence{ nullptr };
+		std::atomic<bool> copying{ false }; // a worker still reads mapped
+
+		std::shared_ptr<Image> image;
+		uint32_t x{ 0 }, y{ 0 }, width{ 0 }, height{ 0 }; // destination in image
+	};
+
+	std::vector<std::unique_ptr<Slot>> m_ring;
+	size_t m_next{ 0 }, m_bufferBytes{ 0 };
+
+	std::vector<std::shared_ptr<Image>> m_images; // by begin() index, released once read back
+	ThreadPool::TaskGroup m_tasks; // copies and encodes
+
+	size_t m_readbacks{ 0 }, m_stalls{ 0 };
+	std::atomic<size_t> m_written{ 0 }, m_failed{ 0 }; // counted by the workers
+
+	Slot& acquireSlot();
+	void complete(Slot& slot);
+
+	static size_t sampleBytes(Format format);
+	static bool encode(const Image& image);
+	static bool writePng(const Image& image);
+	static bool writeExr(const Image& image);
+};
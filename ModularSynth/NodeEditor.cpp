@@ -320,7 +320,7 @@ void NodeEditor::onMouseUp(int button, int x, int y) {
 
 			if(target && input >= 0 && dist < (socketVicinityRadius * socketVicinityRadius)) {
 				if(!target->node()->input(input).connected) 
-					connect(source, m_selectedOutput, target, input);
+					notifyConnectionResult(connect(source, m_selectedOutput, target, input));
 			}
 		}
 		else if(m_selectedInput >= 0) {
@@ -330,7 +330,7 @@ void NodeEditor::onMouseUp(int button, int x, int y) {
 			int dist = getClosestOutput(mouse, target, output);
 
 			if(target && output >= 0 && dist < (socketVicinityRadius * socketVicinityRadius)) {
-				connect(target, output, source, m_selectedInput);
+				notifyConnectionResult(connect(target, output, source, m_selectedInput));
 			}
 		}
 	}
@@ -349,6 +349,17 @@ void NodeEditor::onMouseUp(int button, int x, int y) {
 	m_state = NodeEditorState::idling;
 }
 
+void NodeEditor::notifyConnectionResult(ConnectionResult result) {
+#ifdef _DEBUG
+	switch (result) {
+		default: break;
+		case ConnectionResult::inputInUse: std::cout << "Connection refused: the input is already connected.\n"; break;
+		case ConnectionResult::cycle: std::cout << "Connection refused: it would create a loop.\n"; break;
+	}
+#endif
+	if (result != ConnectionResult::ok && onConnectionRefused) onConnectionRefused(result);
+}
+
 std::vector<VisualConnection> NodeEditor::getConnectionsTo(VisualNode* node) {
 	std::vector<VisualConnection> ret;
 	for (auto&& conn : m_connections) {
@@ -665,7 +676,7 @@ Dimension VisualNode::computeSize(NVGcontext* ctx) {
 	return m_size;
 }
 
-void NodeEditor::connect(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput) {
+ConnectionResult NodeEditor::connect(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput) {
 	VisualConnection conn{
 		.source = source,
 		.destination = destination,
@@ -673,10 +684,12 @@ void NodeEditor::connect(VisualNode* source, size_t sourceOutput, VisualNode* de
 		.sourceOutput = sourceOutput
 	};
 
-	if (m_graph->connect(source->node(), sourceOutput, destination->node(), destinationInput)) {
+	auto result = m_graph->connect(source->node(), sourceOutput, destination->node(), destinationInput);
+	if (result == ConnectionResult::ok) {
 		m_connections.push_back(conn);
-		m_graph->solve();
+		solveGraph();
 	}
+	return result;
 }
 
 void NodeEditor::removeConnection(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput) {
@@ -689,6 +702,26 @@ void NodeEditor::removeConnection(VisualNode* source, size_t sourceOutput, Visua
 	if (pos == m_connections.end()) return;
 	m_connections.erase(pos);
 	m_graph->removeConnection(source->node(), sourceOutput, destination->node(), destinationInput);
+	solveGraph();
+}
+
+void NodeEditor::beginEdit() {
+	m_graph->beginEdit();
+}
+
+void NodeEditor::commitEdit() {
+	m_graph->commitEdit();
+	if (!m_graph->editing() && m_solvePending) {
+		m_solvePending = false;
+		m_graph->solve();
+	}
+}
+
+void NodeEditor::solveGraph() {
+	if (m_graph->editing()) {
+		m_solvePending = true;
+		return;
+	}
 	m_graph->solve();
 }
 
@@ -705,8 +738,7 @@ void NodeEditor::remove(size_t id) {
 	auto node = get(id);
 	if (node == nullptr) return;
 
-	m_graph->remove(node->node()->id());
-
+	// drop the links while the graph node is still alive
 	std::vector<VisualConnection> connToRemove;
 	for (const auto& conn : m_connections) {
 		if (conn.destination == node || conn.source == node) {
@@ -714,12 +746,19 @@ void NodeEditor::remove(size_t id) {
 		}
 	}
 
+	beginEdit();
 	for (const auto& conn : connToRemove) {
 		removeConnection(conn.source, conn.sourceOutput, conn.destination, conn.destinationInput);
 	}
 
-	auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [id](const std::unique_ptr<VisualNode>& nd) {
-		return nd->id() == id;
+	m_graphNodeIndex.erase(node->node()->id());
+	m_graph->remove(node->node()->id());
+	commitEdit();
+
+	m_nodeIndex.erase(id);
+
+	auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [node](const std::unique_ptr<VisualNode>& nd) {
+		return nd.get() == node;
 	});
 
 	if (pos != m_nodes.end()) {
@@ -728,3 +767,12 @@ void NodeEditor::remove(size_t id) {
 
 	rebuildDrawOrder();
 }
+
+bool NodeEditor::setOriginalNodeId(VisualNode* node, size_t id) {
+	size_t oldId = node->node()->id();
+	if (!m_graph->setNodeId(node->node(), id)) return false;
+
+	m_graphNodeIndex.erase(oldId);
+	m_graphNodeIndex.insert(id, node);
+	return true;
+}
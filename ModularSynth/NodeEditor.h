@@ -12,6 +12,7 @@
 #include <functional>
 
 #include "NodeGraph.h"
+#include "IdMap.h"
 
 enum class NodeEditorState {
 	idling = 0,
@@ -95,6 +96,8 @@ public:
 		node->solve();
 
 		m_nodes.push_back(std::unique_ptr<T>(instance));
+		m_nodeIndex.insert(instance->m_id, instance);
+		m_graphNodeIndex.insert(node->id(), instance);
 
 		rebuildDrawOrder();
 
@@ -105,43 +108,36 @@ public:
 
 	int getClosestOutput(Point p, VisualNode*& node, int& inputRectIndex);
 
-	VisualNode* get(size_t id) {
-		auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [id](const std::unique_ptr<VisualNode>& ob) {
-			return ob->id() == id;
-		});
-		if (pos != m_nodes.end()) {
-			return pos->get();
-		}
-		return nullptr;
-	}
+	VisualNode* get(size_t id) const { return m_nodeIndex.get(id); }
+	VisualNode* getFromOriginalNodeId(size_t id) const { return m_graphNodeIndex.get(id); }
 
-	VisualNode* getFromOriginalNodeId(size_t id) {
-		auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [id](const std::unique_ptr<VisualNode>& ob) {
-			return ob->node()->id() == id;
-			});
-		if (pos != m_nodes.end()) {
-			return pos->get();
-		}
-		return nullptr;
-	}
+	// Restores the saved id of the graph node behind a visual node
+	bool setOriginalNodeId(VisualNode* node, size_t id);
 
 	void remove(size_t id);
 
-	void connect(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput);
+	ConnectionResult connect(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput);
 	void removeConnection(VisualNode* source, size_t sourceOutput, VisualNode* destination, size_t destinationInput);
 
+	// Batches graph edits: the graph is solved once, when the outermost edit is committed
+	void beginEdit();
+	void commitEdit();
+
 	NodeGraph* graph() { return m_graph.get(); }
 
 	std::function<void(VisualNode*)> onSelect{ nullptr };
 	std::function<void()> onParamChange{ nullptr };
+	std::function<void(ConnectionResult)> onConnectionRefused{ nullptr };
 
 private:
 	std::vector<std::unique_ptr<VisualNode>> m_nodes;
+	IdMap<VisualNode> m_nodeIndex, m_graphNodeIndex;
 	std::vector<VisualConnection> m_connections;
 
 	std::vector<size_t> m_drawOrders;
 
 	std::unique_ptr<NodeGraph> m_graph;
+	bool m_solvePending{ false };
 
 	float m_proximityAnimation = 0.0f;
 
@@ -152,6 +148,8 @@ private:
 	Point m_mousePos{ 0, 0 };
 
 	void rebuildDrawOrder();
+	void notifyConnectionResult(ConnectionResult result);
+	void solveGraph();
 
 	std::vector<VisualConnection> getConnectionsTo(VisualNode* node);
 	std::vector<VisualConnection> getConnectionsFrom(VisualNode* node);
@@ -1,8 +1,8 @@
 #include "NodeGraph.h"
+#include "ThreadPool.h"
 
 #include <cassert>
-#include <stack>
-#include <queue>
+#include <algorithm>
 
 size_t NodeGraph::g_NodeID = 1;
 
@@ -36,63 +36,295 @@ NodeValue* Node::input(const std::string& in) {
 }
 
 
-bool NodeGraph::connect(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput) {
+void Node::markChanged() {
+	m_changed = true;
+	markDirty();
+
+	if (m_graph && !m_reported) {
+		m_reported = true;
+		m_graph->m_changedNodes.push_back(this);
+	}
+}
+
+ConnectionResult NodeGraph::connect(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput) {
 	Connection conn{
 		.source = source,
 		.destination = destination,
 		.destinationInput = destinationInput,
 		.sourceOutput = sourceOutput
 	};
+	if (destination->m_inputs[destinationInput].connected) {
+		return ConnectionResult::inputInUse;
+	}
+
+	if (!reorderForConnection(source, destination)) {
+		return ConnectionResult::cycle;
+	}
+
 	source->m_outputs[sourceOutput].connected = true;
-	if (!destination->m_inputs[destinationInput].connected) 
-	{
-		destination->m_inputs[destinationInput].connected = true;
-		m_connections.push_back(conn);
-		buildNodePath();
-		return true;
+	destination->m_inputs[destinationInput].connected = true;
+	source->m_outputConnections.push_back(conn);
+	destination->m_inputConnections.push_back(conn);
+	destination->markDirty();
+	invalidateNodePath();
+	return ConnectionResult::ok;
+}
+
+/*
+ * DYNAMIC TOPOLOGICAL ORDER (Pearce-Kelly)
+ * ====================================================
+ * m_topologicalOrder always satisfies order(source) < order(destination) for every connection.
+ * When a new connection breaks that, only the nodes between the two positions are looked at:
+ * 1. Walk forward from the destination, never past the source position.
+ *    Reaching the source means the connection would close a loop.
+ * 2. Walk backward from the source, never before the destination position.
+ * 3. Give the backward set the lowest of the freed positions, followed by the forward set.
+ */
+bool NodeGraph::reorderForConnection(Node* source, Node* destination) {
+	if (source == destination) return false;
+
+	const size_t lowerBound = destination->m_order;
+	const size_t upperBound = source->m_order;
+	if (upperBound < lowerBound) return true; // already in order
+
+	std::vector<Node*> forward, backward, stack, visited;
+
+	auto visit = [&](Node* node) {
+		node->m_visited = true;
+		visited.push_back(node);
+		stack.push_back(node);
+	};
+
+	auto clearVisited = [&]() {
+		for (Node* node : visited) node->m_visited = false;
+	};
+
+	visit(destination);
+	while (!stack.empty()) {
+		Node* node = stack.back(); stack.pop_back();
+		forward.push_back(node);
+
+		for (const auto& conn : node->m_outputConnections) {
+			Node* next = conn.destination;
+			if (next == source) {
+				clearVisited();
+				return false;
+			}
+			if (!next->m_visited && next->m_order < upperBound) {
+				visit(next);
+			}
+		}
 	}
-	return false;
+
+	visit(source);
+	while (!stack.empty()) {
+		Node* node = stack.back(); stack.pop_back();
+		backward.push_back(node);
+
+		for (const auto& conn : node->m_inputConnections) {
+			Node* prev = conn.source;
+			if (!prev->m_visited && prev->m_order > lowerBound) {
+				visit(prev);
+			}
+		}
+	}
+
+	clearVisited();
+
+	auto byOrder = [](const Node* a, const Node* b) { return a->m_order < b->m_order; };
+	std::sort(forward.begin(), forward.end(), byOrder);
+	std::sort(backward.begin(), backward.end(), byOrder);
+
+	std::vector<size_t> positions;
+	positions.reserve(forward.size() + backward.size());
+	for (Node* node : backward) positions.push_back(node->m_order);
+	for (Node* node : forward) positions.push_back(node->m_order);
+	std::sort(positions.begin(), positions.end());
+
+	size_t i = 0;
+	for (Node* node : backward) {
+		node->m_order = positions[i++];
+		m_topologicalOrder[node->m_order] = node;
+	}
+	for (Node* node : forward) {
+		node->m_order = positions[i++];
+		m_topologicalOrder[node->m_order] = node;
+	}
+
+	return true;
 }
 
-void NodeGraph::removeConnection(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput) {
-	auto pos = std::find_if(m_connections.begin(), m_connections.end(), [=](const Connection& cn) {
-		return cn.destination == destination &&
-			cn.destinationInput == destinationInput &&
-			cn.source == source &&
-			cn.sourceOutput == sourceOutput;
+static bool eraseConnection(std::vector<Connection>& list, const Connection& conn) {
+	auto pos = std::find_if(list.begin(), list.end(), [&](const Connection& cn) {
+		return cn.destination == conn.destination &&
+			cn.destinationInput == conn.destinationInput &&
+			cn.source == conn.source &&
+			cn.sourceOutput == conn.sourceOutput;
 	});
-	if (pos == m_connections.end()) return;
-	source->m_outputs[sourceOutput].connected = false;
+	if (pos == list.end()) return false;
+	list.erase(pos);
+	return true;
+}
+
+void NodeGraph::removeConnection(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput) {
+	Connection conn{
+		.source = source,
+		.destination = destination,
+		.destinationInput = destinationInput,
+		.sourceOutput = sourceOutput
+	};
+	if (!eraseConnection(destination->m_inputConnections, conn)) return;
+	eraseConnection(source->m_outputConnections, conn);
+
+	// the output may still be feeding other nodes
+	source->m_outputs[sourceOutput].connected = std::any_of(
+		source->m_outputConnections.begin(),
+		source->m_outputConnections.end(),
+		[sourceOutput](const Connection& cn) { return cn.sourceOutput == sourceOutput; }
+	);
 	destination->m_inputs[destinationInput].connected = false;
-	m_connections.erase(pos);
-	buildNodePath();
+	destination->markDirty();
+	invalidateNodePath();
+}
+
+void NodeGraph::beginEdit() {
+	m_editDepth++;
+}
+
+void NodeGraph::commitEdit() {
+	assert(m_editDepth > 0);
+	if (--m_editDepth > 0) return;
+
+	if (m_pathDirty) buildNodePath();
+}
+
+void NodeGraph::invalidateNodePath() {
+	m_pathDirty = true;
+	if (m_editDepth == 0) buildNodePath();
+}
+
+void NodeGraph::updateNodePath() {
+	if (m_pathDirty || m_nodePath.empty()) buildNodePath();
 }
 
 void NodeGraph::solve() {
-	if (m_nodePath.empty()) buildNodePath();
+	updateNodePath();
 
-	std::stack<Node*> nodes;
-	for (size_t i = m_nodePath.size(); i-- > 0;) {
-		Node* node = get(m_nodePath[i]);
+	auto nodes = collectDirtyNodes();
+	for (Node* node : nodes) {
 		node->m_solved = false;
 		node->m_changed = false;
-		nodes.push(node);
 	}
 
 	// solve nodes
-	while (!nodes.empty()) {
-		Node* node = nodes.top(); nodes.pop();
-		if (!node->m_solved) {
-			node->solve();
+	if (m_threadPool && nodes.size() >= g_ParallelSolveThreshold) {
+		solveParallel(nodes);
+	}
+	else {
+		for (Node* node : nodes) {
+			solveNode(node);
+		}
+	}
+
+	m_lastSolveCount = nodes.size();
+}
+
+void NodeGraph::solveNode(Node* node) {
+	// get values, the sources are solved by now or were clean (a new connection from an unchanged node)
+	for (const auto& conn : getNodeInputConnections(node)) {
+		node->input(conn.destinationInput).value = conn.source->texture(conn.sourceOutput).value;
+	}
+
+	if (!node->m_solved) {
+		node->solve();
+	}
+	node->m_dirty = false;
+}
+
+/*
+ * Each node becomes a task once all of its inputs coming from the solve set are done.
+ * A finished node releases its dependents, so independent branches run on different workers.
+ */
+void NodeGraph::solveParallel(const std::vector<Node*>& nodes) {
+	for (Node* node : nodes) node->m_visited = true;
+
+	std::vector<Node*> roots;
+	for (Node* node : nodes) {
+		size_t pending = 0;
+		for (const auto& conn : node->m_inputConnections) {
+			if (conn.source->m_visited) pending++;
 		}
+		node->m_pendingTasks = pending;
+		if (pending == 0) roots.push_back(node);
+	}
 
-		// set values
-		for (auto conn : getNodeOutputConnections(node)) {
-			Node* from = conn.source;
-			Node* to = conn.destination;
-			to->input(conn.destinationInput).value = from->texture(conn.sourceOutput).value;
+	ThreadPool& pool = *m_threadPool;
+	ThreadPool::TaskGroup group;
+	std::function<void(Node*)> run = [&](Node* node) {
+		solveNode(node);
+
+		for (const auto& conn : node->m_outputConnections) {
+			Node* next = conn.destination;
+			if (next->m_visited && --next->m_pendingTasks == 0) {
+				pool.submit([&run, next]() { run(next); }, &group);
+			}
 		}
+	};
+
+	for (Node* node : roots) {
+		pool.submit([&run, node]() { run(node); }, &group);
 	}
+
+	// other work on the pool (image exports...) is not waited for
+	pool.wait(group);
+
+	for (Node* node : nodes) node->m_visited = false;
+}
+
+/*
+ * Gathers every dirty node plus everything downstream of it,
+ * sorted by the topological order maintained in NodeGraph::connect.
+ */
+std::vector<Node*> NodeGraph::collectDirtyNodes() {
+	std::vector<Node*> nodes;
+	for (auto&& node : m_nodes) {
+		if (node->m_dirty) {
+			node->m_visited = true;
+			nodes.push_back(node.get());
+		}
+	}
+
+	for (size_t head = 0; head < nodes.size(); head++) {
+		for (const auto& conn : nodes[head]->m_outputConnections) {
+			Node* next = conn.destination;
+			if (!next->m_visited) {
+				next->m_visited = true;
+				nodes.push_back(next);
+			}
+		}
+	}
+
+	for (Node* node : nodes) node->m_visited = false;
+
+	std::sort(nodes.begin(), nodes.end(), [](const Node* a, const Node* b) {
+		return a->m_order < b->m_order;
+	});
+	return nodes;
+}
+
+bool NodeGraph::setNodeId(Node* node, size_t id) {
+	if (node->m_id == id) return true;
+	if (id > IdMap<Node>::g_MaxId) return false;
+
+	Node* other = m_nodeIndex.get(id);
+	if (other != nullptr) return false;
+
+	m_nodeIndex.erase(node->m_id);
+	node->m_id = id;
+	m_nodeIndex.insert(id, node);
+
+	g_NodeID = std::max(g_NodeID, id + 1);
+	return true;
 }
 
 bool NodeGraph::hasChanges() const {
@@ -108,41 +340,25 @@ void NodeGraph::clearChanges() {
 	}
 }
 
-std::vector<Connection> NodeGraph::getNodeInputConnections(Node* node) {
-	std::vector<Connection> ret;
-	for (auto&& conn : m_connections) {
-		if (conn.destination == node) {
-			ret.push_back(conn);
-		}
-	}
-	return ret;
-}
-
-std::vector<Connection> NodeGraph::getNodeOutputConnections(Node* node) {
-	std::vector<Connection> ret;
-	for (auto&& conn : m_connections) {
-		if (conn.source == node) {
-			ret.push_back(conn);
-		}
-	}
-	return ret;
+std::vector<Node*> NodeGraph::takeChangedNodes() {
+	for (Node* node : m_changedNodes) node->m_reported = false;
+	return std::move(m_changedNodes);
 }
 
-std::vector<Connection> NodeGraph::getConnectionsToInput(Node* node, size_t input) {
-	std::vector<Connection> ret;
-	for (auto&& conn : m_connections) {
-		if (conn.destination == node && conn.destinationInput == input) {
-			ret.push_back(conn);
+const Connection* NodeGraph::getConnectionToInput(Node* node, size_t input) const {
+	for (const auto& conn : node->m_inputConnections) {
+		if (conn.destinationInput == input) {
+			return &conn;
 		}
 	}
-	return ret;
+	return nullptr;
 }
 
 std::vector<size_t> NodeGraph::getPathFrom(Node* node) {
 	assert(node != nullptr);
 
 	std::vector<size_t> path;
-	for (auto conn : getNodeOutputConnections(node)) {
+	for (const auto& conn : getNodeOutputConnections(node)) {
 		path.push_back(conn.destination->id());
 	}
 	return path;
@@ -151,9 +367,7 @@ std::vector<size_t> NodeGraph::getPathFrom(Node* node) {
 std::vector<size_t> NodeGraph::getLeftMostNodes() {
 	std::vector<size_t> ret;
 	for (auto&& node : m_nodes) {
-		Node* nodePtr = node.get();
-		auto connections = getNodeInputConnections(nodePtr);
-		if (connections.empty()) {
+		if (node->m_inputConnections.empty()) {
 			ret.push_back(node->id());
 		}
 	}
@@ -163,10 +377,8 @@ std::vector<size_t> NodeGraph::getLeftMostNodes() {
 std::vector<size_t> NodeGraph::getRightMostNodes() {
 	std::vector<size_t> ret;
 	for (auto&& node : m_nodes) {
-		Node* nodePtr = node.get();
 		for (size_t i = 0; i < node->m_outputs.size(); i++) {
-			auto connections = getNodeOutputConnections(nodePtr);
-			if (connections.empty()) {
+			if (node->m_outputConnections.empty()) {
 				ret.push_back(node->id());
 			}
 		}
@@ -179,41 +391,38 @@ std::vector<size_t> NodeGraph::getRightMostNodes() {
 #endif
 
 void NodeGraph::buildNodePath() {
-#define nodeExistsVec(vec, nid) (std::find(vec.begin(), vec.end(), (nid)) != vec.end())
-#define nodeExists(nid) nodeExistsVec(m_nodePath, nid)
+	m_pathDirty = false;
 	m_nodePath.clear();
+	m_nodeLevels.clear();
 
-	std::vector<size_t> nodeQueue;
-	for (size_t nid : getLeftMostNodes()) {
-		nodeQueue.push_back(nid);
-	}
+	// Kahn's algorithm: a node is ready once all of its input connections are resolved.
+	// The ready list doubles as a FIFO, so the order only depends on node creation and connection order.
+	std::vector<Node*> ready;
+	ready.reserve(m_nodes.size());
 
-	while (!nodeQueue.empty()) {
-		size_t pid = nodeQueue.front();
-		if (nodeExists(pid)) {
-			nodeQueue.erase(nodeQueue.begin());
-			continue;
+	for (auto&& node : m_nodes) {
+		node->m_pendingInputs = node->m_inputConnections.size();
+		node->m_level = 0;
+		if (node->m_pendingInputs == 0) {
+			ready.push_back(node.get());
 		}
+	}
 
-		auto path = getPathFrom(get(pid));
-		for (size_t nid : path) nodeQueue.push_back(nid);
+	for (size_t head = 0; head < ready.size(); head++) {
+		Node* node = ready[head];
+		m_nodePath.push_back(node->id());
 
-		// are all the inputs processed?
-		bool ok = true;
-		for (const auto& conn : getNodeInputConnections(get(pid))) {
-			if (!nodeExists(conn.source->id())) {
-				ok = false;
-				break;
-			}
+		if (node->m_level >= m_nodeLevels.size()) {
+			m_nodeLevels.resize(node->m_level + 1);
 		}
+		m_nodeLevels[node->m_level].push_back(node->id());
 
-		if (ok) {
-			m_nodePath.push_back(pid);
-			nodeQueue.erase(nodeQueue.begin());
-		}
-		else {
-			nodeQueue.erase(nodeQueue.begin());
-			nodeQueue.insert(nodeQueue.end(), pid);
+		for (const auto& conn : node->m_outputConnections) {
+			Node* next = conn.destination;
+			next->m_level = std::max(next->m_level, node->m_level + 1);
+			if (--next->m_pendingInputs == 0) {
+				ready.push_back(next);
+			}
 		}
 	}
 
@@ -228,6 +437,10 @@ void NodeGraph::buildNodePath() {
 		i++;
 	}
 	std::cout << "]\n";
+
+	if (m_nodePath.size() != m_nodes.size()) {
+		std::cout << "[WARNING] " << (m_nodes.size() - m_nodePath.size()) << " node(s) are part of a cycle and were left out\n";
+	}
 #endif
 }
 
@@ -236,22 +449,29 @@ void NodeGraph::remove(size_t id) {
 	if (node == nullptr) return;
 
 	std::vector<Connection> connToRemove;
-	for (const auto& conn : m_connections) {
-		if (conn.destination == node || conn.source == node) {
-			connToRemove.push_back(conn);
-		}
-	}
+	connToRemove.insert(connToRemove.end(), node->m_inputConnections.begin(), node->m_inputConnections.end());
+	connToRemove.insert(connToRemove.end(), node->m_outputConnections.begin(), node->m_outputConnections.end());
 
+	beginEdit();
 	for (const auto& conn : connToRemove) {
 		removeConnection(conn.source, conn.sourceOutput, conn.destination, conn.destinationInput);
 	}
 
-	auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [id](const std::unique_ptr<Node>& nd) {
-		return nd->id() == id;
+	m_topologicalOrder.erase(m_topologicalOrder.begin() + node->m_order);
+	for (size_t i = node->m_order; i < m_topologicalOrder.size(); i++) {
+		m_topologicalOrder[i]->m_order = i;
+	}
+
+	m_nodeIndex.erase(id);
+	std::erase(m_changedNodes, node);
+
+	auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [node](const std::unique_ptr<Node>& nd) {
+		return nd.get() == node;
 	});
 	if (pos != m_nodes.end()) {
 		m_nodes.erase(pos);
 	}
 
-	buildNodePath();
+	invalidateNodePath();
+	commitEdit();
 }
@@ -5,6 +5,10 @@
 #include <string>
 #include <cstdint>
 #include <memory>
+#include <span>
+#include <atomic>
+
+#include "IdMap.h"
 
 using RawValue = std::array<float, 4>;
 
@@ -23,6 +27,15 @@ struct NodeValue {
 	bool connected{ false };
 };
 
+class Node;
+class NodeGraph;
+struct Connection {
+	Node* source;
+	Node* destination;
+	size_t destinationInput;
+	size_t sourceOutput;
+};
+
 class Node {
 	friend class NodeGraph;
 public:
@@ -55,62 +68,121 @@ public:
 
 	bool changed() const { return m_changed; }
 
+	// Flags the node for re-evaluation. Its downstream nodes follow on the next NodeGraph::solve.
+	void markDirty() { m_dirty = true; }
+	bool dirty() const { return m_dirty; }
+
+	// Settings edits (params, formats...): dirty, and reported to the graph (see NodeGraph::takeChangedNodes)
+	void markChanged();
+
 protected:
 	bool m_solved{ false };
 	bool m_changed{ false };
+	bool m_dirty{ true };
+
+	// scratch state used by NodeGraph::buildNodePath
+	size_t m_pendingInputs{ 0 }, m_level{ 0 };
+
+	// position in the incrementally maintained topological order (see NodeGraph::connect)
+	size_t m_order{ 0 };
+	bool m_visited{ false };
+
+	// unsolved inputs left before the node can run, used by the parallel solver
+	std::atomic<size_t> m_pendingTasks{ 0 };
 
 	size_t m_id{ 0 };
+	NodeGraph* m_graph{ nullptr };
+	bool m_reported{ false }; // in the graph's changed list
+
 	std::vector<NodeValue> m_inputs, m_outputs;
 	std::vector<std::string> m_inputNames, m_outputNames;
+
+	// adjacency lists, maintained by NodeGraph
+	std::vector<Connection> m_inputConnections, m_outputConnections;
 };
 
 template <typename T>
 concept NodeObject = std::is_base_of<Node, T>::value;
 
-struct Connection {
-	Node* source;
-	Node* destination;
-	size_t destinationInput;
-	size_t sourceOutput;
+enum class ConnectionResult {
+	ok = 0,
+	inputInUse,
+	cycle
 };
 
+using NodeHandle = IdMap<Node>::Handle;
+
+class ThreadPool;
+
 class NodeGraph {
+	friend class Node;
 public:
 	template <NodeObject T>
 	T* create() {
 		T* instance = new T();
 		instance->m_id = g_NodeID++;
+		instance->m_graph = this;
+		instance->m_order = m_topologicalOrder.size();
+		m_topologicalOrder.push_back(instance);
 		m_nodes.push_back(std::unique_ptr<Node>(instance));
+		m_nodeIndex.insert(instance->m_id, instance);
+		m_pathDirty = true;
 		m_nodes.back()->setup();
 		return dynamic_cast<T*>(m_nodes.back().get());
 	}
 
-	Node* get(size_t id) {
-		auto pos = std::find_if(m_nodes.begin(), m_nodes.end(), [id](const std::unique_ptr<Node>& ob) {
-			return ob->id() == id;
-		});
-		if (pos != m_nodes.end()) {
-			return pos->get();
-		}
-		return nullptr;
-	}
+	Node* get(size_t id) const { return m_nodeIndex.get(id); }
+	Node* get(const NodeHandle& handle) const { return m_nodeIndex.get(handle); }
+	NodeHandle handle(size_t id) const { return m_nodeIndex.handle(id); }
+
+	// Gives a node the id it had when it was saved. Fails if the id is taken by another node or out of range.
+	bool setNodeId(Node* node, size_t id);
 
 	void remove(size_t id);
 
-	bool connect(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput);
+	ConnectionResult connect(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput);
 	void removeConnection(Node* source, size_t sourceOutput, Node* destination, size_t destinationInput);
 
+	// Edits between beginEdit and the matching commitEdit don't rebuild the node path.
+	// It is rebuilt once, when the outermost edit is committed. Calls can be nested.
+	void beginEdit();
+	void commitEdit();
+	bool editing() const { return m_editDepth > 0; }
+
 	virtual void solve();
+
+	// number of nodes re-evaluated by the last solve
+	size_t lastSolveCount() const { return m_lastSolveCount; }
+
+	// When set, solve() runs independent nodes as tasks on the pool once at least g_ParallelSolveThreshold
+	// nodes need solving. Node::solve must be thread safe. Not set by default.
+	void setThreadPool(ThreadPool* pool) { m_threadPool = pool; }
+	ThreadPool* threadPool() const { return m_threadPool; }
 	size_t lastNode() const { return m_nodePath.empty() ? 0 : m_nodePath.front(); }
 
+	// Node ids in execution order.
+	const std::vector<size_t>& nodePath() const { return m_nodePath; }
+
+	// Node ids grouped by depth. Nodes in the same level don't depend on each other.
+	const std::vector<std::vector<size_t>>& levels() const { return m_nodeLevels; }
+
 	bool hasChanges() const;
 	void clearChanges();
 
+	// Nodes that called markChanged since the last call, in the order they did
+	std::vector<Node*> takeChangedNodes();
+
 	static size_t g_NodeID;
 
+	// below this many nodes, a task per node costs more than solving them in a row
+	static constexpr size_t g_ParallelSolveThreshold = 1024;
+
 protected:
 	std::vector<std::unique_ptr<Node>> m_nodes;
-	std::vector<Connection> m_connections;
+	IdMap<Node> m_nodeIndex;
+
+	// every node ordered so that connections always go from a lower to a higher index
+	std::vector<Node*> m_topologicalOrder;
 
 	/*
 	 * SOLVING A NODE GRAPH FROM LEFT TO RIGHT
@@ -118,19 +190,35 @@ protected:
 	 * 1. Get all the input nodes (left-most nodes with no input connections)
 	 * 2. For each input node found:
 	 *		a. Solve the node (run the behavior code)
-	 *		b. For each connection on each output, set the next node inputs accordingly
-	 *		c. Solve the next node
+	 *		b. Solve the next node, which first reads its inputs from the outputs connected to them
 	 */
 
 	std::vector<size_t> m_nodePath;
+	std::vector<std::vector<size_t>> m_nodeLevels;
+
+	size_t m_editDepth{ 0 };
+	bool m_pathDirty{ false };
 
-	std::vector<Connection> getConnectionsToInput(Node* node, size_t input);
+	std::vector<Node*> m_changedNodes;
 
-	std::vector<Connection> getNodeInputConnections(Node* node);
-	std::vector<Connection> getNodeOutputConnections(Node* node);
+	size_t m_lastSolveCount{ 0 };
+	ThreadPool* m_threadPool{ nullptr };
+
+	const Connection* getConnectionToInput(Node* node, size_t input) const;
+
+	std::span<const Connection> getNodeInputConnections(Node* node) const { return node->m_inputConnections; }
+	std::span<const Connection> getNodeOutputConnections(Node* node) const { return node->m_outputConnections; }
 	std::vector<size_t> getLeftMostNodes();
 	std::vector<size_t> getRightMostNodes();
 	std::vector<size_t> getPathFrom(Node* node);
 	void buildNodePath();
+	void invalidateNodePath();
+	void updateNodePath();
+
+	std::vector<Node*> collectDirtyNodes();
+	void solveNode(Node* node);
+	void solveParallel(const std::vector<Node*>& nodes);
+
+	bool reorderForConnection(Node* source, Node* destination);
 
 };
@@ -1,14 +1,48 @@
 #include "Shader.h"
 
 #include <Windows.h>
+#include <string_view>
 
 Shader::~Shader() {
+	for (auto shader : m_shaders) {
+		glDeleteShader(shader);
+	}
+
 	if (!m_program) return;
 
 	glDeleteProgram(m_program);
 	m_program = 0;
 }
 
+// GL_KHR_parallel_shader_compile isn't part of our glad build, so it's loaded by hand
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static bool parallelCompileSupported() {
+	static const bool supported = []() {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+		bool found = false;
+		for (GLint i = 0; i < count && !found; i++) {
+			auto ext = std::string_view(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)));
+			found = ext == "GL_KHR_parallel_shader_compile" || ext == "GL_ARB_parallel_shader_compile";
+		}
+		if (!found) return false;
+
+		auto maxThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(wglGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+		if (!maxThreads) {
+			maxThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(wglGetProcAddress("glMaxShaderCompilerThreadsARB"));
+		}
+		if (maxThreads) {
+			maxThreads(0xFFFFFFFF); // let the driver pick
+		}
+		return true;
+	}();
+	return supported;
+}
+
 void Shader::add(const std::string& src, GLenum type) {
 	if (m_program == 0) {
 		m_program = glCreateProgram();
@@ -23,26 +57,95 @@ void Shader::add(const std::string& src, GLenum type) {
 }
 
 void Shader::link() {
+	beginLink();
+	finishLink();
+}
+
+void Shader::beginLink() {
+	parallelCompileSupported();
 	glLinkProgram(m_program);
+}
+
+bool Shader::linkCompleted() const {
+	if (!parallelCompileSupported()) return true;
 
+	GLint done = GL_TRUE;
+	glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+bool Shader::finishLink() {
 	GLint status;
 	glGetProgramiv(m_program, GL_LINK_STATUS, &status);
 	if (status != GL_TRUE) {
 		char log[1024];
+
+		// compile errors only show up here, compiling doesn't wait for the result
+		for (auto shader : m_shaders) {
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+			if (status == GL_TRUE) continue;
+
+			glGetShaderInfoLog(shader, 1024, nullptr, log);
+			OutputDebugStringA(log);
+			OutputDebugStringA("\n");
+		}
+
 		glGetProgramInfoLog(m_program, 1024, nullptr, log);
 
 		OutputDebugStringA(log);
 		OutputDebugStringA("\n");
 
 		glDeleteProgram(m_program);
-		return;
+		m_program = 0;
+		return false;
 	}
 
+	m_linked = true;
+
 	/*for (auto shader : m_shaders) {
 		glDetachShader(m_program, shader);
 		glDeleteShader(shader);
 	}
 	m_shaders.clear();*/
+	return true;
+}
+
+void Shader::setBinaryRetrievable() {
+	if (m_program == 0) {
+		m_program = glCreateProgram();
+	}
+	glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool Shader::getBinary(GLenum& format, std::vector<uint8_t>& data) const {
+	if (!m_linked) return false;
+
+	GLint length = 0;
+	glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return false;
+
+	data.resize(size_t(length));
+
+	GLsizei written = 0;
+	glGetProgramBinary(m_program, length, &written, &format, data.data());
+	data.resize(size_t(written));
+
+	return written > 0;
+}
+
+bool Shader::loadBinary(GLenum format, const void* data, size_t size) {
+	if (m_program == 0) {
+		m_program = glCreateProgram();
+	}
+
+	glProgramBinary(m_program, format, data, GLsizei(size));
+
+	// binaries are rejected when the driver changed, the program then has to be built from source
+	GLint status;
+	glGetProgramiv(m_program, GL_LINK_STATUS, &status);
+	m_linked = status == GL_TRUE;
+
+	return m_linked;
 }
 
 GLint Shader::getUniformLocation(const std::string& name) {
@@ -59,20 +162,7 @@ GLuint Shader::createShader(const std::string& src, GLenum type) {
 	const char* srcRaw[] = { src.c_str() };
 	const GLint srcLength[] = { src.size() };
 	glShaderSource(shader, 1, srcRaw, srcLength);
-	glCompileShader(shader);
-	
-	GLint status;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-	if (status != GL_TRUE) {
-		char log[1024];
-		glGetShaderInfoLog(shader, 1024, nullptr, log);
-
-		OutputDebugStringA(log);
-		OutputDebugStringA("\n");
-
-		glDeleteShader(shader);
-		return 0;
-	}
+	glCompileShader(shader); // the status is checked once linked, so the driver can compile in the background
 
 	return shader;
 }
@@ -7,6 +7,7 @@
 #include <string>
 #include <functional>
 #include <cassert>
+#include <cstdint>
 
 class Shader {
 public:
@@ -16,6 +17,19 @@ public:
 	void add(const std::string& src, GLenum type);
 	void link();
 
+	// Non-blocking link: beginLink() starts it, linkCompleted() polls it
+	// (GL_KHR_parallel_shader_compile, always true without the extension) and
+	// finishLink() checks the result, blocking if the driver isn't done yet.
+	void beginLink();
+	bool linkCompleted() const;
+	bool finishLink();
+
+	// Program binaries, see glGetProgramBinary/glProgramBinary.
+	// Call setBinaryRetrievable before link() so the driver keeps the binary around.
+	void setBinaryRetrievable();
+	bool getBinary(GLenum& format, std::vector<uint8_t>& data) const;
+	bool loadBinary(GLenum format, const void* data, size_t size);
+
 	GLint getUniformLocation(const std::string& name);
 	GLint getAttributeLocation(const std::string& name);
 
@@ -50,9 +64,11 @@ public:
 	}
 
 	GLuint id() const { return m_program; }
+	bool linked() const { return m_linked; }
 
 private:
-	GLuint m_program;
+	GLuint m_program{ 0 };
+	bool m_linked{ false };
 	std::vector<GLuint> m_shaders;
 
 	GLuint createShader(const std::string& src, GLenum type);
@@ -0,0 +1,376 @@
+#include "ShaderCache.h"
+
+#include <format>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+// disk cache file layout: header, then the program binary
+struct BinaryHeader {
+	char magic[4];
+	uint32_t version;
+	uint8_t sourceDigest[32]; // SHA-256 of the source, the file name only holds its first 64 bits
+	uint64_t sourceSize;
+	uint32_t format;
+	uint32_t size;
+};
+
+static constexpr char g_BinaryMagic[4] = { 'M', 'S', 'P', 'B' };
+static constexpr uint32_t g_BinaryVersion = 2;
+
+ShaderCache& ShaderCache::shared() {
+	static ShaderCache cache{};
+	return cache;
+}
+
+// FIPS 180-4
+ShaderCache::Digest ShaderCache::digest(std::string_view src) {
+	static constexpr uint32_t k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+	auto compress = [&](const uint8_t* block) {
+		uint32_t w[64];
+		for (int i = 0; i < 16; i++) {
+			w[i] = uint32_t(block[i * 4]) << 24 | uint32_t(block[i * 4 + 1]) << 16 | uint32_t(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+		}
+		for (int i = 16; i < 64; i++) {
+			const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+		for (int i = 0; i < 64; i++) {
+			const uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	};
+
+	const auto data = reinterpret_cast<const uint8_t*>(src.data());
+	size_t offset = 0;
+	for (; offset + 64 <= src.size(); offset += 64) {
+		compress(data + offset);
+	}
+
+	// the rest, a 1 bit, zeros and the length in bits, in one or two blocks
+	uint8_t tail[128]{};
+	const size_t rest = src.size() - offset;
+	std::copy(data + offset, data + src.size(), tail);
+	tail[rest] = 0x80;
+
+	const size_t tailSize = rest < 56 ? 64 : 128;
+	const uint64_t bits = uint64_t(src.size()) * 8;
+	for (int i = 0; i < 8; i++) {
+		tail[tailSize - 1 - i] = uint8_t(bits >> (i * 8));
+	}
+	compress(tail);
+	if (tailSize == 128) compress(tail + 64);
+
+	Digest out{};
+	for (int i = 0; i < 8; i++) {
+		out[i * 4] = uint8_t(h[i] >> 24);
+		out[i * 4 + 1] = uint8_t(h[i] >> 16);
+		out[i * 4 + 2] = uint8_t(h[i] >> 8);
+		out[i * 4 + 3] = uint8_t(h[i]);
+	}
+	return out;
+}
+
+uint64_t ShaderCache::key(const Digest& digest) {
+	uint64_t k = 0;
+	for (size_t i = 0; i < 8; i++) {
+		k = k << 8 | digest[i];
+	}
+	return k;
+}
+
+std::shared_ptr<Shader> ShaderCache::get(const std::string& src) {
+	if (auto shader = find(src)) {
+		return shader;
+	}
+	return finish(src, compile(src));
+}
+
+std::shared_ptr<Shader> ShaderCache::find(const std::string& src) {
+	const Digest sourceDigest = digest(src);
+	const uint64_t key = ShaderCache::key(sourceDigest);
+
+	auto found = m_index.find(key);
+	if (found != m_index.end()) {
+		auto it = found->second;
+		if (it->source == src) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			m_stats.hits++;
+			return it->shader;
+		}
+
+		// hash collision, the new source takes the slot
+		erase(it);
+	}
+
+	m_stats.misses++;
+
+	std::string path = binaryPath(key);
+	if (path.empty()) return nullptr;
+
+	auto shader = loadFromDisk(path, sourceDigest, src.size());
+	if (shader) {
+		insert(key, src, shader);
+	}
+	return shader;
+}
+
+std::shared_ptr<Shader> ShaderCache::compile(const std::string& src) {
+	auto shader = std::make_shared<Shader>();
+	shader->add(src, GL_COMPUTE_SHADER);
+	if (!m_diskCacheDirectory.empty()) shader->setBinaryRetrievable();
+	shader->beginLink();
+	return shader;
+}
+
+std::shared_ptr<Shader> ShaderCache::finish(const std::string& src, std::shared_ptr<Shader> shader) {
+	if (!shader || !shader->finishLink()) {
+		return nullptr;
+	}
+
+	const Digest sourceDigest = digest(src);
+	const uint64_t key = ShaderCache::key(sourceDigest);
+
+	std::string path = binaryPath(key);
+	if (!path.empty()) saveToDisk(path, sourceDigest, src.size(), *shader);
+
+	insert(key, src, shader);
+	return shader;
+}
+
+void ShaderCache::insert(uint64_t key, const std::string& src, const std::shared_ptr<Shader>& shader) {
+	auto found = m_index.find(key);
+	if (found != m_index.end()) {
+		erase(found->second);
+	}
+
+	GLint binaryLength = 0;
+	glGetProgramiv(shader->id(), GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	size_t bytes = binaryLength > 0 ? size_t(binaryLength) : src.size();
+
+	m_entries.push_front({ key, src, shader, bytes });
+	m_index[key] = m_entries.begin();
+	m_stats.bytes += bytes;
+	m_stats.programs++;
+
+	trim();
+}
+
+void ShaderCache::setByteBudget(size_t bytes) {
+	m_byteBudget = bytes;
+	trim();
+}
+
+void ShaderCache::clear() {
+	m_entries.clear();
+	m_index.clear();
+	m_stats.bytes = 0;
+	m_stats.programs = 0;
+}
+
+void ShaderCache::erase(std::list<Entry>::iterator it) {
+	m_stats.bytes -= it->bytes;
+	m_stats.programs--;
+	m_index.erase(it->hash);
+	m_entries.erase(it);
+}
+
+// Evicts the least recently used programs until the cache fits the budget.
+// The most recent program is always kept. Evicted programs that are still in use
+// stay alive until their last owner lets go of them.
+void ShaderCache::trim() {
+	while (m_stats.bytes > m_byteBudget && m_entries.size() > 1) {
+		erase(std::prev(m_entries.end()));
+		m_stats.evictions++;
+	}
+}
+
+// identifies the driver the first time, false if it can't give us binaries
+bool ShaderCache::resolveDriver() {
+	if (m_diskCacheDirectory.empty()) return false;
+	if (!m_driverId.empty()) return true;
+
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	if (formatCount <= 0) {
+		m_diskCacheDirectory.clear();
+		return false;
+	}
+
+	auto str = [](GLenum name) {
+		auto value = reinterpret_cast<const char*>(glGetString(name));
+		return std::string(value ? value : "");
+	};
+	m_driverId = str(GL_VENDOR) + "|" + str(GL_RENDERER) + "|" + str(GL_VERSION);
+	m_driverPrefix = std::format("{:016x}_", hash(m_driverId));
+
+	// files of a former driver would never be read again
+	trimDisk();
+	return true;
+}
+
+std::string ShaderCache::binaryPath(uint64_t key) {
+	if (!resolveDriver()) return "";
+	return std::format("{}/{}{:016x}.bin", m_diskCacheDirectory, m_driverPrefix, key);
+}
+
+std::string ShaderCache::diskPath(std::string_view name) {
+	if (!resolveDriver()) return "";
+
+	std::error_code ec;
+	fs::create_directories(m_diskCacheDirectory, ec);
+	if (ec) return "";
+
+	return std::format("{}/{}{}", m_diskCacheDirectory, m_driverPrefix, name);
+}
+
+// the digest and size of the source are checked, a file whose name collides belongs to another source
+std::shared_ptr<Shader> ShaderCache::loadFromDisk(const std::string& path, const Digest& sourceDigest, size_t sourceSize) {
+	std::ifstream fp(path, std::ios::binary);
+	if (!fp.is_open()) {
+		m_stats.diskMisses++;
+		return nullptr;
+	}
+
+	BinaryHeader header{};
+	std::vector<uint8_t> data;
+
+	bool valid = bool(fp.read(reinterpret_cast<char*>(&header), sizeof(header))) &&
+		std::equal(std::begin(g_BinaryMagic), std::end(g_BinaryMagic), header.magic) &&
+		header.version == g_BinaryVersion &&
+		std::equal(sourceDigest.begin(), sourceDigest.end(), header.sourceDigest) &&
+		header.sourceSize == sourceSize &&
+		header.size > 0;
+
+	if (valid) {
+		data.resize(header.size);
+		valid = bool(fp.read(reinterpret_cast<char*>(data.data()), data.size()));
+	}
+	fp.close();
+
+	auto shader = std::make_shared<Shader>();
+	if (!valid || !shader->loadBinary(header.format, data.data(), data.size())) {
+		std::error_code ec;
+		fs::remove(path, ec);
+
+		m_stats.diskMisses++;
+		return nullptr;
+	}
+
+	// most recently used, see trimDisk
+	std::error_code ec;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+	m_stats.diskHits++;
+	return shader;
+}
+
+void ShaderCache::saveToDisk(const std::string& path, const Digest& sourceDigest, size_t sourceSize, const Shader& shader) {
+	GLenum format = 0;
+	std::vector<uint8_t> data;
+	if (!shader.getBinary(format, data)) return;
+
+	std::error_code ec;
+	fs::create_directories(m_diskCacheDirectory, ec);
+	if (ec) return;
+
+	BinaryHeader header{};
+	std::copy(std::begin(g_BinaryMagic), std::end(g_BinaryMagic), header.magic);
+	header.version = g_BinaryVersion;
+	std::copy(sourceDigest.begin(), sourceDigest.end(), header.sourceDigest);
+	header.sourceSize = sourceSize;
+	header.format = format;
+	header.size = uint32_t(data.size());
+
+	// write to a temporary file first, so a crash never leaves a truncated binary behind
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream fp(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!fp.is_open()) return;
+
+		fp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fp.write(reinterpret_cast<const char*>(data.data()), data.size());
+		if (!fp) {
+			fp.close();
+			fs::remove(tmpPath, ec);
+			return;
+		}
+	}
+
+	fs::rename(tmpPath, path, ec);
+	if (ec) fs::remove(tmpPath, ec);
+
+	trimDisk();
+}
+
+void ShaderCache::setDiskByteBudget(size_t bytes) {
+	m_diskByteBudget = bytes;
+	if (!m_driverPrefix.empty()) trimDisk();
+}
+
+// Deletes the files of other drivers, then the least recently written or loaded binaries
+// until the directory fits the budget.
+void ShaderCache::trimDisk() {
+	struct File {
+		fs::path path;
+		fs::file_time_type time;
+		uintmax_t bytes;
+	};
+
+	std::vector<File> files;
+	size_t bytes = 0;
+
+	std::error_code ec;
+	for (const auto& entry : fs::directory_iterator(m_diskCacheDirectory, ec)) {
+		if (!entry.is_regular_file(ec)) continue;
+
+		// every file starts with the prefix of the driver it was written for
+		const auto name = entry.path().filename().string();
+		const bool ours = name.size() > m_driverPrefix.size() && name[m_driverPrefix.size() - 1] == '_';
+		if (ours && !name.starts_with(m_driverPrefix)) {
+			if (fs::remove(entry.path(), ec)) m_stats.diskEvictions++;
+			continue;
+		}
+		if (!ours || entry.path().extension() != ".bin") continue;
+
+		File file{ entry.path(), entry.last_write_time(ec), entry.file_size(ec) };
+		if (ec) continue;
+
+		bytes += file.bytes;
+		files.push_back(std::move(file));
+	}
+	if (bytes <= m_diskByteBudget) return;
+
+	std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.time < b.time; });
+	for (const auto& file : files) {
+		if (bytes <= m_diskByteBudget) break;
+		if (!fs::remove(file.path, ec)) continue;
+
+		bytes -= file.bytes;
+		m_stats.diskEvictions++;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Shader.h"
+
+#include <array>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+ * LRU cache of linked compute programs keyed by their generated source.
+ * Graph states that produce the same source (undo, reconnecting a former topology...)
+ * reuse the existing program instead of going through the driver compiler again.
+ * Sources are keyed by their SHA-256 digest, and still compared in full on lookup.
+ *
+ * Misses first look for a program binary in the disk cache directory before compiling.
+ * Binary files are named after the source key and the driver (vendor, renderer and version),
+ * so a driver update simply misses. Each file holds the full digest and size of its source,
+ * checked on load. Files that don't match or that the driver rejects are deleted and rebuilt.
+ * The directory has its own byte budget: files are touched when loaded and the least recently
+ * used ones are deleted past it. Files of another driver are deleted when the cache first opens it.
+ */
+class ShaderCache {
+public:
+	struct Stats {
+		size_t hits{ 0 }, misses{ 0 }, evictions{ 0 };
+		size_t diskHits{ 0 }, diskMisses{ 0 }, diskEvictions{ 0 };
+		size_t bytes{ 0 }, programs{ 0 };
+	};
+
+	explicit ShaderCache(size_t byteBudget = 64 * 1024 * 1024, size_t diskByteBudget = 256 * 1024 * 1024)
+		: m_byteBudget(byteBudget), m_diskByteBudget(diskByteBudget) {}
+
+	// Returns the linked program for this compute shader source, compiling it on a miss.
+	// Returns nullptr if the source fails to compile or link.
+	std::shared_ptr<Shader> get(const std::string& src);
+
+	// Same as get, split for background compilation:
+	//	find	returns the program if it's in memory or on disk, nullptr otherwise
+	//	compile	starts compiling, the program can be polled with Shader::linkCompleted
+	//	finish	checks the compiled program and adds it to the cache, nullptr if it failed
+	std::shared_ptr<Shader> find(const std::string& src);
+	std::shared_ptr<Shader> compile(const std::string& src);
+	std::shared_ptr<Shader> finish(const std::string& src, std::shared_ptr<Shader> shader);
+
+	void setByteBudget(size_t bytes);
+	size_t byteBudget() const { return m_byteBudget; }
+
+	// empty path disables the disk cache
+	void setDiskCacheDirectory(const std::string& path) { m_diskCacheDirectory = path; }
+	const std::string& diskCacheDirectory() const { return m_diskCacheDirectory; }
+
+	// Path of a file kept with this driver's binaries (other data tied to the driver), empty without disk cache
+	std::string diskPath(std::string_view name);
+
+	void setDiskByteBudget(size_t bytes);
+	size_t diskByteBudget() const { return m_diskByteBudget; }
+
+	const Stats& stats() const { return m_stats; }
+	void clear();
+
+	using Digest = std::array<uint8_t, 32>;
+
+	// SHA-256 of the source
+	static Digest digest(std::string_view src);
+
+	// the first 64 bits of the digest
+	static uint64_t hash(std::string_view src) { return key(digest(src)); }
+	static uint64_t key(const Digest& digest);
+
+	static ShaderCache& shared();
+
+private:
+	struct Entry {
+		uint64_t hash;
+		std::string source;
+		std::shared_ptr<Shader> shader;
+		size_t bytes;
+	};
+
+	std::list<Entry> m_entries; // most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+
+	size_t m_byteBudget, m_diskByteBudget;
+	Stats m_stats{};
+
+	std::string m_diskCacheDirectory{ "shader_cache" };
+	std::string m_driverId;
+	std::string m_driverPrefix; // file name prefix of this driver's binaries
+
+	void insert(uint64_t key, const std::string& src, const std::shared_ptr<Shader>& shader);
+	void erase(std::list<Entry>::iterator it);
+	void trim();
+
+	bool resolveDriver();
+	std::string binaryPath(uint64_t key);
+	std::shared_ptr<Shader> loadFromDisk(const std::string& path, const Digest& sourceDigest, size_t sourceSize);
+	void saveToDisk(const std::string& path, const Digest& sourceDigest, size_t sourceSize, const Shader& shader);
+	void trimDisk();
+};
@@ -1,26 +1,86 @@
 #include "ShaderGen.h"
 
 #include <cctype>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <format>
 #include <iostream>
+#include <mutex>
 
 #include "Window.h"
 
 // HEAVILY INSPIRED BY https://github.com/UPBGE/upbge/blob/upbge0.2.5/source/blender/gpu/intern/gpu_codegen.c#L701
 
+static std::mutex g_LibraryCacheMutex;
+static std::unordered_map<const SourceTemplate*, std::shared_ptr<const ShaderLibrary>> g_LibraryCache;
+
+std::shared_ptr<const ShaderLibrary> ShaderLibrary::get(const SourceTemplate& src) {
+	std::lock_guard<std::mutex> lock(g_LibraryCacheMutex);
+
+	auto it = g_LibraryCache.find(&src);
+	if (it != g_LibraryCache.end()) {
+		return it->second;
+	}
+
+	auto lib = std::make_shared<ShaderLibrary>();
+	lib->parse(src.source());
+	g_LibraryCache[&src] = lib;
+	return lib;
+}
+
+std::shared_ptr<const ShaderLibrary> ShaderLibrary::create(const std::string& src) {
+	auto lib = std::make_shared<ShaderLibrary>();
+	lib->parse(src);
+	return lib;
+}
+
 void ShaderGen::loadLib(const std::string& src) {
-	const std::regex identifierName("[a-zA-Z0-9_]");
+	auto lib = ShaderLibrary::create(src);
+	for (const auto& [name, func] : lib->functions()) {
+		m_shaderLib[name] = &func;
+	}
+	m_libraries.push_back(std::move(lib));
+}
+
+void ShaderGen::loadLib(const SourceTemplate& src, size_t nodeId, std::string_view treeName) {
+	auto lib = ShaderLibrary::get(src);
+	for (const auto& [name, func] : lib->functions()) {
+		m_shaderLib[name] = &func;
+	}
+
+	// only the text changes, the parameters were parsed with the template
+	for (const auto& tmpl : lib->templates()) {
+		ShaderFunction& func = m_instances.emplace_back(tmpl.function);
+		func.name = tmpl.name.fill(nodeId, treeName);
+		func.source = tmpl.source.fill(nodeId, treeName);
+		func.dependencies.clear();
+		for (const auto& dep : tmpl.dependencies) {
+			func.dependencies.push_back(dep.fill(nodeId, treeName));
+		}
+		m_shaderLib[func.name] = &func;
+	}
+	m_libraries.push_back(std::move(lib));
+}
+
+const ShaderFunction& ShaderGen::getFunction(const std::string& name) const {
+	static const ShaderFunction empty{};
+	auto it = m_shaderLib.find(name);
+	return it != m_shaderLib.end() ? *it->second : empty;
+}
+
+void ShaderLibrary::parse(const std::string& src) {
 	StringScanner ss{ src };
 
-	while (ss.peek()) {
+	while (!ss.atEnd()) {
 		size_t pos = ss.position();
 		char c = ss.scan();
 
-		if (std::isalpha(c)) { // check for functions
-			std::string retType = c + ss.scanWhile(identifierName);
+		if (StringScanner::is(c, StringScanner::alpha)) { // check for functions
+			ss.scanWhile(StringScanner::templateIdentifier); // return type
 			ss.skipSpaces();
 
-			std::string identifier = ss.scanWhile(identifierName);
+			std::string_view identifier = ss.scanWhile(StringScanner::templateIdentifier);
 			ss.skipSpaces();
 
 			if (ss.peek() != '(') { // expect function signature, otherwise it's not a function.
@@ -35,12 +95,14 @@ void ShaderGen::loadLib(const std::string& src) {
 			func.stringIndex = pos;
 
 			// read parameters
-			while (ss.peek() != ')') {
+			while (ss.peek() != ')' && !ss.atEnd()) {
 
 				// read param
-				std::vector<std::string> paramStr;
-				while (ss.peek() != ',' && ss.peek() != ')') {
-					paramStr.push_back(ss.scanWhile(identifierName));
+				std::vector<std::string_view> paramStr;
+				while (ss.peek() != ',' && ss.peek() != ')' && !ss.atEnd()) {
+					auto word = ss.scanWhile(StringScanner::identifier);
+					if (word.empty()) ss.scan(); // skip anything that is not part of a declaration
+					else paramStr.push_back(word);
 					ss.skipSpaces();
 				}
 				if (ss.peek() == ',') ss.scan(); // remove ,
@@ -89,7 +151,7 @@ void ShaderGen::loadLib(const std::string& src) {
 			if (ss.scan() == '{') {
 				braceCount++;
 
-				while (true) {
+				while (!ss.atEnd()) {
 					char bc = ss.scan();
 					if (bc == '{') braceCount++;
 					else if (bc == '}') braceCount--;
@@ -101,7 +163,20 @@ void ShaderGen::loadLib(const std::string& src) {
 			}
 
 			func.stringLength = ss.position() - func.stringIndex;
-			m_shaderLib[func.name] = func;
+			func.source = src.substr(func.stringIndex, func.stringLength);
+			func.dependencies = findDependencies(func.source);
+
+			if (func.source.find('$') != std::string::npos) {
+				FunctionTemplate tmpl{ .name = SourceTemplate(func.name), .source = SourceTemplate(func.source) };
+				for (const auto& dep : func.dependencies) {
+					tmpl.dependencies.emplace_back(dep);
+				}
+				tmpl.function = std::move(func);
+				m_templates.push_back(std::move(tmpl));
+			}
+			else {
+				m_functions[func.name] = std::move(func);
+			}
 
 			ss.skipSpaces();
 		}
@@ -127,48 +202,55 @@ void ShaderGen::endFunctionBlock(Target target) {
 	m_targets[target] += "}\n";
 }
 
-void ShaderGen::pasteFunction(const std::string& funcName, const std::string& shaderCode) {
-	if (std::find(m_pasted.begin(), m_pasted.end(), funcName) != m_pasted.end()) {
-		return;
-	}
-
-	if (m_shaderLib.find(funcName) == m_shaderLib.end()) { // not found? bleh
-		return;
-	}
-
-	auto func = m_shaderLib[funcName];
-	auto src = shaderCode.substr(func.stringIndex, func.stringLength);
-
-	// check for dependent functions
-	const std::regex identifierName("[a-zA-Z0-9_]");
+std::vector<std::string> ShaderLibrary::findDependencies(std::string_view src) {
+	std::vector<std::string> deps;
 	StringScanner ss{ src };
 
-	while (ss.peek()) {
-		size_t pos = ss.position();
+	while (!ss.atEnd()) {
 		char c = ss.scan();
 
-		if (std::isalpha(c)) { // check for functions
-			std::string identifier = c + ss.scanWhile(identifierName);
+		if (StringScanner::is(c, StringScanner::alpha)) { // check for functions
+			size_t start = ss.position() - 1;
+			ss.scanWhile(StringScanner::templateIdentifier);
+			std::string_view identifier = src.substr(start, ss.position() - start);
 			ss.skipSpaces();
 
 			if (ss.peek() != '(') { // expect function signature, otherwise it's not a function.
 				continue;
 			}
 
-			while (ss.peek() != ')' && ss.peek() != 0) ss.scan();
+			while (ss.peek() != ')' && !ss.atEnd()) ss.scan();
 			if (ss.peek() == ')') ss.scan();
 			ss.skipSpaces();
 
-			if (ss.peek() == ';') {
-				pasteFunction(identifier, shaderCode);
+			if (ss.peek() == ';' && std::find(deps.begin(), deps.end(), identifier) == deps.end()) {
+				deps.emplace_back(identifier);
 			}
 		}
 	}
 
-	m_targets[Target::definitions] += src;
-	m_targets[Target::definitions] += "\n\n";
+	return deps;
+}
+
+void ShaderGen::pasteFunction(const std::string& funcName) {
+	if (m_pasted.contains(funcName)) {
+		return;
+	}
 
-	m_pasted.push_back(funcName);
+	auto it = m_shaderLib.find(funcName);
+	if (it == m_shaderLib.end()) { // not found? bleh
+		return;
+	}
+
+	m_pasted.insert(funcName);
+
+	const ShaderFunction& func = *it->second;
+	for (const auto& dep : func.dependencies) {
+		pasteFunction(dep);
+	}
+
+	m_targets[Target::definitions] += func.source;
+	m_targets[Target::definitions] += "\n\n";
 }
 
 void ShaderGen::convertType(ValueType from, ValueType to, const std::string& varName) {
@@ -208,9 +290,9 @@ void ShaderGen::convertType(ValueType from, ValueType to, const std::string& var
 	}
 }
 
-std::string ShaderGen::appendUniform(ValueType type, const std::string& name, size_t binding) {
+std::string ShaderGen::appendUniform(ValueType type, const std::string& name, size_t binding, const std::string& imageFormat) {
 	if (type == ValueType::image) {
-		m_targets[Target::uniforms] += std::format("layout (rgba32f, binding={}) uniform image2D {};", binding, name);
+		m_targets[Target::uniforms] += std::format("layout ({}, binding={}) uniform image2D {};", imageFormat, binding, name);
 	}
 	else {
 		m_targets[Target::uniforms] += std::format("uniform {} {};", typeStr[size_t(type)], name);
@@ -219,6 +301,31 @@ std::string ShaderGen::appendUniform(ValueType type, const std::string& name, si
 	return name;
 }
 
+// same as a uniform, but the value is a literal the driver can fold
+std::string ShaderGen::appendConstant(ValueType type, const std::string& name, const RawValue& value) {
+	// GLSL has no inf/nan literals, they are clamped to the nearest finite value (nan to 0)
+	auto literal = [](float v) {
+		if (std::isnan(v)) v = 0.0f;
+		v = std::clamp(v, -std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+
+		auto str = std::format("{}", v);
+		if (str.find_first_of(".e") == std::string::npos) str += ".0";
+		return str;
+	};
+
+	std::string init;
+	switch (type) {
+		case ValueType::scalar: init = literal(value[0]); break;
+		case ValueType::vec2: init = std::format("vec2({}, {})", literal(value[0]), literal(value[1])); break;
+		case ValueType::vec3: init = std::format("vec3({}, {}, {})", literal(value[0]), literal(value[1]), literal(value[2])); break;
+		case ValueType::vec4: init = std::format("vec4({}, {}, {}, {})", literal(value[0]), literal(value[1]), literal(value[2]), literal(value[3])); break;
+		default: return appendUniform(type, name);
+	}
+
+	m_targets[Target::uniforms] += std::format("const {} {} = {};\n", typeStr[size_t(type)], name, init);
+	return name;
+}
+
 std::string ShaderGen::appendVariable(ValueType type, const std::string& name) {
 	if (type == ValueType::image) {
 		type = ValueType::vec4;
@@ -235,6 +342,7 @@ void ShaderGen::append(const std::string& str) {
 
 std::string ShaderGen::generate() {
 	std::string src = shaderTemplate;
+	src.replace(src.find("<layout>"), 8, std::format("layout (local_size_x={}, local_size_y={}) in;", m_workGroupSize.x, m_workGroupSize.y));
 	src.replace(src.find("<uniforms>"), 10, m_targets[Target::uniforms]);
 	src.replace(src.find("<defs>"), 6, m_targets[Target::definitions]);
 	src.replace(src.find("<body>"), 6, m_targets[Target::body]);
@@ -1,20 +1,27 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <regex>
+#include <unordered_set>
+#include <memory>
+#include <array>
 #include <stack>
+#include <deque>
 
 #include "NodeGraph.h"
+#include "SourceTemplate.h"
 
 const std::string typeStr[] = {
 	"", "float", "vec2", "vec3", "vec4", "image2D"
 };
 
 const std::string shaderTemplate = R"(#version 460
-layout (local_size_x=16, local_size_y=16) in;
+<layout>
 
 uniform vec2 bOutputSize;
+uniform ivec2 bTileOffset; // first pixel of the dispatch, output and intermediate images start there (see TextureNodeGraph::renderTiled)
+uniform int bPass; // see TextureNodeGraph::RenderPass
 
 <uniforms>
 
@@ -35,6 +42,7 @@ vec3 hash3(vec2 p) {
 
 #define Tex(name, uv) imageLoad(name, ivec2(uv * vec2(imageSize(name).xy)))
 #define TexP(name, uv, ox, oy) imageLoad(name, ivec2(uv * vec2(imageSize(name).xy)) + ivec2(ox, oy))
+#define TileCoords(uv) (ivec2((uv) * bOutputSize) - bTileOffset)
 #define PI 3.141592654
 
 float rand(float n) { return fract(sin(n) * 43758.5453123); }
@@ -53,13 +61,19 @@ float rgba_to_float(vec4 color) {
 <defs>
 
 void main() {
-	ivec2 cCoords = ivec2(gl_GlobalInvocationID.xy);
-	vec2 cUV = vec2(cCoords) / vec2(gl_NumWorkGroups.xy * 16);
+	ivec2 cCoords = ivec2(gl_GlobalInvocationID.xy) + bTileOffset;
+	vec2 cUV = vec2(cCoords) / bOutputSize;
 	
 <body>
 }
 )";
 
+struct WorkGroupSize {
+	uint32_t x{ 16 }, y{ 16 };
+
+	bool operator==(const WorkGroupSize&) const = default;
+};
+
 struct ShaderFunctionParam {
 	ValueType type;
 	enum {
@@ -75,6 +89,41 @@ struct ShaderFunction {
 	std::unordered_map<std::string, ShaderFunctionParam> parameters;
 	std::vector<std::string> parameterOrder;
 	size_t stringIndex{ 0 }, stringLength{ 0 };
+
+	std::string source; // full definition, signature and body
+	std::vector<std::string> dependencies; // functions called by the body
+};
+
+/*
+ * Parsed function table of a library source.
+ * Node libraries are parsed once per node type, with their $ placeholders left in, and shared
+ * process-wide. Functions with placeholders are kept as templates that ShaderGen::loadLib fills
+ * in for each node, so many instances of the same node type only pay for one parse.
+ */
+class ShaderLibrary {
+public:
+	struct FunctionTemplate {
+		ShaderFunction function; // parsed from the unfilled source
+		SourceTemplate name, source;
+		std::vector<SourceTemplate> dependencies;
+	};
+
+	// Cached by template, which has to outlive the library (node type templates are static, see GraphicsNode)
+	static std::shared_ptr<const ShaderLibrary> get(const SourceTemplate& src);
+
+	// not cached, for one-off sources
+	static std::shared_ptr<const ShaderLibrary> create(const std::string& src);
+
+	// the functions without placeholders
+	const std::unordered_map<std::string, ShaderFunction>& functions() const { return m_functions; }
+	const std::vector<FunctionTemplate>& templates() const { return m_templates; }
+
+private:
+	std::unordered_map<std::string, ShaderFunction> m_functions;
+	std::vector<FunctionTemplate> m_templates;
+
+	void parse(const std::string& src);
+	static std::vector<std::string> findDependencies(std::string_view body);
 };
 
 class ShaderGen {
@@ -87,14 +136,19 @@ public:
 
 	void loadLib(const std::string& src);
 
+	// a node library, with $NODE and $TREE filled in for that node
+	void loadLib(const SourceTemplate& src, size_t nodeId, std::string_view treeName = "");
+
 	void beginCodeBlock();
 	void endCodeBlock(Target target);
 	
 	void beginFunctionBlock(const std::string& signature);
 	void endFunctionBlock(Target target);
 
-	void pasteFunction(const std::string& funcName, const std::string& shaderCode);
-	std::string appendUniform(ValueType type, const std::string& name, size_t binding = 0);
+	void pasteFunction(const std::string& funcName);
+	// imageFormat is the layout qualifier of image uniforms (rgba32f, r16f...)
+	std::string appendUniform(ValueType type, const std::string& name, size_t binding = 0, const std::string& imageFormat = "rgba32f");
+	std::string appendConstant(ValueType type, const std::string& name, const RawValue& value);
 
 	void append(const std::string& str);
 	std::string appendVariable(ValueType type, const std::string& name);
@@ -103,7 +157,11 @@ public:
 
 	std::string generate();
 
-	const ShaderFunction& getFunction(const std::string& name) { return m_shaderLib[name]; }
+	// compute shader local size, the dispatch has to cover the output with it (see TextureNodeGraph::render)
+	void setWorkGroupSize(const WorkGroupSize& size) { m_workGroupSize = size; }
+	const WorkGroupSize& workGroupSize() const { return m_workGroupSize; }
+
+	const ShaderFunction& getFunction(const std::string& name) const;
 	std::string& target(Target target) { return m_targets[target]; }
 
 protected:
@@ -111,57 +169,82 @@ protected:
 	std::stack<std::string> m_userCodeBlocks;
 
 	size_t m_tmpIndex{ 0 };
+	WorkGroupSize m_workGroupSize{};
 
-	std::unordered_map<std::string, ShaderFunction> m_shaderLib;
-	std::vector<std::string> m_pasted;
+	std::vector<std::shared_ptr<const ShaderLibrary>> m_libraries; // keeps m_shaderLib entries alive
+	std::deque<ShaderFunction> m_instances; // filled templates, also in m_shaderLib
+	std::unordered_map<std::string, const ShaderFunction*> m_shaderLib;
+	std::unordered_set<std::string> m_pasted;
 
 
 };
 
-template <typename Char = char>
+/*
+ * Forward-only cursor over a source string.
+ * Characters are classified with a lookup table, and scanned tokens are returned
+ * as views into the input, so scanning is linear and doesn't allocate.
+ * The input must outlive the scanner and the views it returns.
+ */
 class StringScanner {
 public:
-	using Str = std::basic_string<Char>;
-	using RegExp = std::basic_regex<Char>;
+	enum CharClass : uint8_t {
+		none = 0,
+		space = 1 << 0,
+		alpha = 1 << 1,
+		digit = 1 << 2,
+		underscore = 1 << 3,
+		dollar = 1 << 4,
+		identifier = alpha | digit | underscore,
+		templateIdentifier = identifier | dollar // with SourceTemplate placeholders
+	};
 
 	StringScanner() = default;
-	StringScanner(const Str& input) {
-		m_data = std::vector<Char>(input.begin(), input.end());
+	StringScanner(std::string_view input) : m_data(input) {}
+
+	static bool is(char c, uint8_t charClass) { return (g_CharClasses[uint8_t(c)] & charClass) != 0; }
+
+	char peek(size_t offset = 0) const {
+		return m_position + offset < m_data.size() ? m_data[m_position + offset] : '\0';
 	}
 
-	Char peek(size_t offset = 0) const { return m_data.empty() ? '\0' : m_data[offset]; }
-	Char scan() {
-		if (m_data.empty()) return '\0';
-		Char tmp = m_data.front();
-		m_data.erase(m_data.begin());
-		m_position++;
-		return tmp;
+	char scan() {
+		if (m_position >= m_data.size()) return '\0';
+		return m_data[m_position++];
 	}
 
-	std::string scanWhile(RegExp re) {
-		std::string ret = "";
-		while (peek() != '\0' && std::regex_match(Str(1, peek()), re)) {
-			ret += scan();
+	std::string_view scanWhile(uint8_t charClass) {
+		size_t start = m_position;
+		while (m_position < m_data.size() && is(m_data[m_position], charClass)) {
+			m_position++;
 		}
-		return ret;
+		return m_data.substr(start, m_position - start);
 	}
 
-	std::string peekWhile(RegExp re) {
-		std::string ret = "";
-		size_t offset = 0;
-		while (peek(offset) != '\0' && std::regex_match(Str(1, peek(offset)), re)) {
-			ret += peek(offset++);
+	std::string_view peekWhile(uint8_t charClass) const {
+		size_t end = m_position;
+		while (end < m_data.size() && is(m_data[end], charClass)) {
+			end++;
 		}
-		return ret;
+		return m_data.substr(m_position, end - m_position);
 	}
 
-	void skipSpaces() {
-		scanWhile(std::basic_regex<Char>("\\s"));
-	}
+	void skipSpaces() { scanWhile(space); }
 
+	bool atEnd() const { return m_position >= m_data.size(); }
 	size_t position() const { return m_position; }
 
 private:
-	std::vector<Char> m_data;
+	std::string_view m_data;
 	size_t m_position{ 0 };
+
+	static constexpr std::array<uint8_t, 256> g_CharClasses = []() {
+		std::array<uint8_t, 256> table{};
+		for (char c : std::string_view(" \t\n\v\f\r")) table[uint8_t(c)] |= space;
+		for (int c = 'a'; c <= 'z'; c++) table[c] |= alpha;
+		for (int c = 'A'; c <= 'Z'; c++) table[c] |= alpha;
+		for (int c = '0'; c <= '9'; c++) table[c] |= digit;
+		table['_'] |= underscore;
+		table['$'] |= dollar;
+		return table;
+	}();
 };
@@ -0,0 +1,84 @@
+#include "SourceTemplate.h"
+
+#include <charconv>
+
+static constexpr struct {
+	std::string_view name;
+	SourceTemplate::Placeholder placeholder;
+} g_Placeholders[] = {
+	{ "NODE", SourceTemplate::Placeholder::node },
+	{ "TREE", SourceTemplate::Placeholder::tree }
+};
+
+SourceTemplate::SourceTemplate(std::string_view source) {
+	m_text.reserve(source.size());
+
+	size_t literalStart = 0;
+	size_t pos = 0;
+	while ((pos = source.find('$', pos)) != std::string_view::npos) {
+		Placeholder found = Placeholder::none;
+		size_t nameLength = 0;
+		for (const auto& [name, placeholder] : g_Placeholders) {
+			if (source.substr(pos + 1, name.size()) == name) {
+				found = placeholder;
+				nameLength = name.size();
+				break;
+			}
+		}
+
+		if (found == Placeholder::none) {
+			pos++;
+			continue;
+		}
+
+		std::string_view literal = source.substr(literalStart, pos - literalStart);
+		m_segments.push_back({ m_text.size(), literal.size(), found });
+		m_text += literal;
+
+		pos += 1 + nameLength;
+		literalStart = pos;
+	}
+
+	std::string_view tail = source.substr(literalStart);
+	m_segments.push_back({ m_text.size(), tail.size(), Placeholder::none });
+	m_text += tail;
+}
+
+std::string SourceTemplate::fill(size_t nodeId, std::string_view treeName) const {
+	std::string out;
+	out.reserve(m_text.size() + m_segments.size() * 16);
+	fillInto(out, nodeId, treeName);
+	return out;
+}
+
+void SourceTemplate::fillInto(std::string& out, size_t nodeId, std::string_view treeName) const {
+	char idText[24];
+	auto [idEnd, ec] = std::to_chars(idText, idText + sizeof(idText), nodeId);
+	std::string_view id{ idText, size_t(idEnd - idText) };
+
+	for (const auto& segment : m_segments) {
+		out.append(m_text, segment.offset, segment.length);
+
+		switch (segment.placeholder) {
+			case Placeholder::node: out += id; break;
+			case Placeholder::tree: out += treeName; break;
+			default: break;
+		}
+	}
+}
+
+std::string SourceTemplate::source() const {
+	std::string out;
+	out.reserve(m_text.size() + m_segments.size() * 5);
+
+	for (const auto& segment : m_segments) {
+		out.append(m_text, segment.offset, segment.length);
+		for (const auto& [name, placeholder] : g_Placeholders) {
+			if (placeholder == segment.placeholder) {
+				out += '$';
+				out += name;
+			}
+		}
+	}
+	return out;
+}
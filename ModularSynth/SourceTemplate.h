@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Shader source with $ placeholders, tokenized once.
+ * Node libraries only change per node type, so they are parsed a single time
+ * and then filled in with plain appends for every node instance.
+ *
+ * Supported placeholders:
+ *	$NODE	the node id
+ *	$TREE	the name of the subtree function a multipass node samples from
+ * Anything else following a $ is kept as is.
+ */
+class SourceTemplate {
+public:
+	enum class Placeholder : uint8_t {
+		none = 0,
+		node,
+		tree
+	};
+
+	SourceTemplate() = default;
+	explicit SourceTemplate(std::string_view source);
+
+	std::string fill(size_t nodeId, std::string_view treeName = "") const;
+	void fillInto(std::string& out, size_t nodeId, std::string_view treeName = "") const;
+
+	// the source it was made from, placeholders included
+	std::string source() const;
+
+	bool hasPlaceholders() const { return m_segments.size() > 1; }
+
+private:
+	struct Segment {
+		size_t offset{ 0 }, length{ 0 }; // literal text that comes before the placeholder
+		Placeholder placeholder{ Placeholder::none };
+	};
+
+	std::string m_text;
+	std::vector<Segment> m_segments;
+};
@@ -1,5 +1,7 @@
 #include "Texture.h"
 
+#include <algorithm>
+
 Texture::Texture(GLenum internalFormat, size_t dimensions, GLenum target) {
 	m_target = target;
 	m_internalFormat = internalFormat;
@@ -11,10 +13,13 @@ Texture::Texture(
 	const std::array<uint32_t, 3>& size,
 	GLenum internalFormat,
 	size_t dimensions,
-	GLenum target
-) : Texture(internalFormat, dimensions, target)
-{
+	GLenum target,
+	uint32_t levels
+) {
+	m_target = target;
+	m_internalFormat = internalFormat;
 	m_size = size;
+	m_levels = std::max<uint32_t>(levels, 1);
 	init(dimensions);
 }
 
@@ -28,9 +33,9 @@ void Texture::init(size_t dimensions) {
 
 	switch (dimensions) {
 		default: break;
-		case 1: glTextureStorage1D(m_id, 1, m_internalFormat, m_size[0]); break;
-		case 2: glTextureStorage2D(m_id, 1, m_internalFormat, m_size[0], m_size[1]); break;
-		case 3: glTextureStorage3D(m_id, 1, m_internalFormat, m_size[0], m_size[1], m_size[2]); break;
+		case 1: glTextureStorage1D(m_id, m_levels, m_internalFormat, m_size[0]); break;
+		case 2: glTextureStorage2D(m_id, m_levels, m_internalFormat, m_size[0], m_size[1]); break;
+		case 3: glTextureStorage3D(m_id, m_levels, m_internalFormat, m_size[0], m_size[1], m_size[2]); break;
 	}
 
 	if (dimensions >= 1) {
@@ -43,6 +48,12 @@ void Texture::init(size_t dimensions) {
 		glTextureParameteri(m_id, GL_TEXTURE_WRAP_R, GL_REPEAT);
 	}
 
+	// single channel images display as grayscale, like they are read in the generated code
+	if (m_internalFormat == GL_R8 || m_internalFormat == GL_R16F || m_internalFormat == GL_R32F) {
+		const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTextureParameteriv(m_id, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
 	// TODO: Set filter
 	glTextureParameteri(m_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTextureParameteri(m_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -6,16 +6,54 @@
 
 #include "glad/glad.h"
 
+// Formats a node image (Output target, loaded Image) can be stored in.
+// Single channel formats read back as (r, r, r, 1), see Texture::init and TextureNodeGraph::generate.
+enum class StorageFormat : uint8_t {
+	rgba32f = 0,
+	rgba16f,
+	rgba8,
+	r32f,
+	r16f,
+	r8
+};
+
+struct StorageFormatInfo {
+	GLenum internalFormat;
+	const char* qualifier; // GLSL image format
+	const char* name;
+	uint32_t channels;
+};
+
+constexpr StorageFormatInfo storageFormats[] = {
+	{ GL_RGBA32F, "rgba32f", "RGBA32F", 4 },
+	{ GL_RGBA16F, "rgba16f", "RGBA16F", 4 },
+	{ GL_RGBA8, "rgba8", "RGBA8", 4 },
+	{ GL_R32F, "r32f", "R32F", 1 },
+	{ GL_R16F, "r16f", "R16F", 1 },
+	{ GL_R8, "r8", "R8", 1 }
+};
+
+constexpr const StorageFormatInfo& storageFormatInfo(StorageFormat format) {
+	return storageFormats[size_t(format)];
+}
+
 class Texture {
 public:
 	Texture(GLenum internalFormat = GL_RGBA8, size_t dimensions = 2, GLenum target = GL_TEXTURE_2D);
-	Texture(const std::array<uint32_t, 3>& size, GLenum internalFormat = GL_RGBA8, size_t dimensions = 2, GLenum target = GL_TEXTURE_2D);
+	Texture(
+		const std::array<uint32_t, 3>& size,
+		GLenum internalFormat = GL_RGBA8,
+		size_t dimensions = 2,
+		GLenum target = GL_TEXTURE_2D,
+		uint32_t levels = 1
+	);
 	virtual ~Texture();
 
 	GLuint id() const { return m_id; }
 	GLenum internalFormat() const { return m_internalFormat; }
 	GLenum format() const { return m_format; }
 	const std::array<uint32_t, 3>& size() const { return m_size; }
+	uint32_t levels() const { return m_levels; }
 
 	void loadFromMemory(void* data, GLenum format, GLenum type) {
 		assert(m_target == GL_TEXTURE_2D);
@@ -29,6 +67,7 @@ private:
 	GLenum m_target;
 	GLenum m_internalFormat, m_format{ 0 };
 	std::array<uint32_t, 3> m_size;
+	uint32_t m_levels{ 1 };
 
 	void init(size_t dimensions);
 };
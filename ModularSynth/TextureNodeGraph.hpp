@@ -4,265 +4,1265 @@
 #include "GraphicsNode.h"
 #include "ShaderGen.h"
 #include "Shader.h"
+#include "ShaderCache.h"
 #include "Texture.h"
+#include "GraphInterpreter.h"
+#include "GpuProfiler.h"
 
 #include <format>
+#include <functional>
 #include <fstream>
-#include <stack>
-#include <regex>
+#include <algorithm>
+#include <typeinfo>
+#include <span>
+#include <unordered_set>
+#include <unordered_map>
+#include <set>
+#include <map>
+#include <deque>
+#include <filesystem>
 
 class TextureNodeGraph : public NodeGraph {
+public:
+	// An image the generated program reads or writes. Bound to the image unit of its index in RenderPlan::bindings.
+	struct ImageBinding {
+		enum class Kind : uint8_t {
+			output = 0,
+			param,
+			intermediate
+		} kind;
+		size_t nodeId{ 0 }; // for intermediates, the node whose output is stored
+		std::string param{};
+		size_t index{ 0 }; // intermediate image index
+	};
+
+	// What render() needs to run a generated program, kept together with it
+	struct RenderPlan {
+		std::vector<ImageBinding> bindings;
+		size_t passCount{ 0 };
+		size_t intermediateCount{ 0 };
+		WorkGroupSize workGroupSize{}; // the program's local size, see dispatch()
+		bool baked{ false }; // params are constants, see ShaderMode
+	};
+
+	// One dispatch of the generated program.
+	// Nodes inside a pass are fused: each one is evaluated once per pixel and its outputs are shared
+	// through local variables. A materialized output is rendered to an intermediate image by the pass
+	// of its node and sampled by the later passes, see planPasses. The last pass renders the outputs.
+	struct RenderPass {
+		Node* root{ nullptr }; // node materialized by this pass, nullptr for the last pass
+		std::vector<size_t> outputs; // outputs of the root stored to intermediate images
+		std::vector<Node*> nodes; // in execution order
+		float cost{ 0.0f }; // estimated, see nodeCost
+	};
+
+	// A rectangle of the output, in pixels
+	struct TileRegion {
+		uint32_t x{ 0 }, y{ 0 }, width{ 0 }, height{ 0 };
+	};
+
+	// Called by renderTiled for every Output node once a tile is done. The output texture holds
+	// `image` (the tile and its apron), only `tile` is final.
+	using TileWriter = std::function<void(OutputNode* output, const TileRegion& tile, const TileRegion& image)>;
+
+	enum class ShaderMode : uint8_t {
+		interactive = 0, // params are uniforms, editing them only re-renders
+		baked // params are inlined as literals for the driver to fold, editing them regenerates the shader. For final renders
+	};
+
+	enum class Backend : uint8_t {
+		fused = 0, // a program generated and compiled for each graph state, see generate
+		interpreter // one precompiled program running the graph from buffers, see GraphInterpreter. Interactive mode only
+	};
+
+	enum class MaterializeReason : uint8_t {
+		multipass = 0, // sampled by a multipass node through $TREE
+		shared // evaluated by several passes, cheaper to compute once
+	};
+
+	// cost model units, relative to aluCost
+	static constexpr float g_FetchCost = 4.0f; // reading an intermediate image
+	static constexpr float g_StoreCost = 4.0f; // writing one
+	static constexpr float g_PassCost = 16.0f; // per pixel overhead of an extra dispatch
+
+	static constexpr std::array<WorkGroupSize, 4> g_WorkGroupCandidates = { {
+		{ 8, 8 }, { 16, 16 }, { 32, 8 }, { 64, 1 }
+	} };
+	static constexpr size_t g_TuningRuns = 3; // timed dispatches per candidate, the fastest one counts
+	static constexpr size_t g_TuningDelay = 30; // frames without edits before tuning starts
+	static constexpr size_t g_SharedMemoryBudget = 32 * 1024; // the minimum GL_MAX_COMPUTE_SHARED_MEMORY_SIZE
+	static constexpr size_t g_MaxTunedPrograms = 1024; // tuned shapes remembered, the oldest are forgotten first
+
 private:
-	size_t m_imgId{ 0 }; // 0 is the final output
-	std::map<size_t, std::string> m_subtreeNames;
-	std::map<size_t, std::string> m_subtreeFunctions;
+	RenderPlan m_plan{};
+
+	// optimized graph the shader is generated from, see optimizeGraph
+	std::vector<size_t> m_livePath; // m_nodePath without the dead and merged nodes
+	std::unordered_map<Node*, std::vector<Connection>> m_liveInputs, m_liveOutputs; // sources replaced by the merged nodes
+	std::vector<std::pair<size_t, size_t>> m_mergedNodes; // (removed, kept)
+	size_t m_deadNodeCount{ 0 };
+
+	ShaderMode m_shaderMode{ ShaderMode::interactive };
+	Backend m_backend{ Backend::interpreter };
+
+	// interpreter backend, used instead of generatedShader while m_interpreting
+	GraphInterpreter m_interpreter;
+	RenderPlan m_interpreterPlan{};
+	std::vector<std::pair<size_t, std::string>> m_interpreterConstants; // (node, param), constant i + 1
+	bool m_interpreting{ false };
+	std::unordered_map<size_t, StorageFormat> m_storageFormats; // image formats of the live nodes when the program was built
+
+	// codegen state, see planPasses
+	std::map<std::pair<size_t, size_t>, MaterializeReason> m_materialized; // (node, output)
+	std::set<size_t> m_tiledKernels; // kernel nodes reading their source from shared memory
+	std::string m_planDescription;
+
+	std::vector<std::shared_ptr<Texture>> m_intermediateImages; // reused between renders, from TexturePool
+
+	// program still compiling, see update()
+	std::shared_ptr<Shader> m_pendingShader;
+	std::string m_pendingSource;
+	RenderPlan m_pendingPlan{};
+
+	// workgroup shape auto-tuning, see update()
+	struct TuningCandidate {
+		std::string source;
+		RenderPlan plan;
+		std::shared_ptr<Shader> shader; // compiling, then linked
+		std::array<GLuint, g_TuningRuns> queries{}; // GL_TIME_ELAPSED of the runs, once issued
+		uint64_t time{ UINT64_MAX }; // ns
+	};
+	std::vector<TuningCandidate> m_tuning;
+	size_t m_tuningIndex{ 0 }, m_tuningIdleFrames{ 0 };
+	uint64_t m_tuningKey{ 0 };
+	uint32_t m_renderWidth{ 1024 }, m_renderHeight{ 1024 }; // of the last render(), candidates are timed at that size
+
+	// Fastest shape per program, keyed by the hash of its source generated with the default shape.
+	// Kept with the program binaries of the driver (see ShaderCache::diskPath), one "key x y" line per program, oldest first.
+	struct TunedSizes {
+		std::unordered_map<uint64_t, WorkGroupSize> sizes;
+		std::deque<uint64_t> order; // oldest first
+	};
+
+	static TunedSizes& tunedWorkGroupSizes() {
+		static TunedSizes tuned = []() {
+			TunedSizes loaded{};
+
+			std::ifstream fp(ShaderCache::shared().diskPath("workgroups.txt"));
+			uint64_t key = 0;
+			WorkGroupSize size{};
+			while (fp >> std::hex >> key >> std::dec >> size.x >> size.y) {
+				if (size.x == 0 || size.y == 0) continue;
+				if (!loaded.sizes.contains(key)) loaded.order.push_back(key);
+				loaded.sizes[key] = size;
+			}
+			return loaded;
+		}();
+		return tuned;
+	}
+
+	// the file is rewritten from the map, so it stays within g_MaxTunedPrograms lines
+	static void storeTunedWorkGroupSize(uint64_t key, const WorkGroupSize& size) {
+		auto& tuned = tunedWorkGroupSizes();
+		if (!tuned.sizes.contains(key)) tuned.order.push_back(key);
+		tuned.sizes[key] = size;
+
+		while (tuned.order.size() > g_MaxTunedPrograms) {
+			tuned.sizes.erase(tuned.order.front());
+			tuned.order.pop_front();
+		}
+
+		auto path = ShaderCache::shared().diskPath("workgroups.txt");
+		if (path.empty()) return;
+
+		// written to a temporary file first, so a crash never leaves half of it behind
+		std::string tmpPath = path + ".tmp";
+		{
+			std::ofstream fp(tmpPath, std::ios::trunc);
+			for (uint64_t tunedKey : tuned.order) {
+				const auto& tunedSize = tuned.sizes[tunedKey];
+				fp << std::format("{:016x} {} {}\n", tunedKey, tunedSize.x, tunedSize.y);
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmpPath, path, ec);
+		if (ec) std::filesystem::remove(tmpPath, ec);
+	}
 
 public:
+	TextureNodeGraph() {
+		// Output nodes are stores, see buildProgram
+		m_interpreter.registerNodeType<ColorNode>();
+		m_interpreter.registerNodeType<SimpleGradientNode>();
+		m_interpreter.registerNodeType<MixNode>();
+		m_interpreter.registerNodeType<NoiseNode>();
+		m_interpreter.registerNodeType<ThresholdNode>();
+		m_interpreter.registerNodeType<ImageNode>();
+		m_interpreter.registerNodeType<UVNode>();
+		m_interpreter.registerNodeType<RadialGradientNode>();
+		m_interpreter.registerNodeType<NormalMapNode>();
+		m_interpreter.registerNodeType<CircleShapeNode>();
+		m_interpreter.registerNodeType<BoxShapeNode>();
+		m_interpreter.registerNodeType<WebCamNode>();
+	}
+
+	void setShaderMode(ShaderMode mode) {
+		setPipeline(m_backend, mode);
+	}
+
+	ShaderMode shaderMode() const { return m_shaderMode; }
+
+	void setBackend(Backend backend) {
+		setPipeline(backend, m_shaderMode);
+	}
+
+	// both at once, with a single solve
+	void setPipeline(Backend backend, ShaderMode mode) {
+		if (m_backend == backend && m_shaderMode == mode) return;
+		m_backend = backend;
+		m_shaderMode = mode;
+		solve();
+	}
+
+	Backend backend() const { return m_backend; }
+
+	void solve() override {
+		GpuProfiler::ScopedTimer timer("solve");
+
+		// evaluate the changed nodes first (in parallel), the shader is then generated on the GL thread
+		NodeGraph::solve();
+
+		updateNodePath();
+		optimizeGraph();
+		if (m_livePath.empty()) return;
+
+		m_storageFormats.clear();
+		for (const auto& nodeId : m_livePath) {
+			m_storageFormats[nodeId] = storageFormatOf(static_cast<GraphicsNode*>(get(nodeId)));
+		}
+
+		// topology edits only re-upload the interpreter's buffers, no compile
+		if (m_backend == Backend::interpreter && m_shaderMode == ShaderMode::interactive && m_interpreter.shader()) {
+			GraphInterpreter::Program program{};
+			if (buildProgram(program, m_interpreterPlan, m_interpreterConstants)) {
+				m_interpreter.upload(program);
+
+				m_pendingShader.reset();
+				m_pendingSource.clear();
+				resetTuning();
+
+#ifdef _DEBUG
+				std::ofstream planOf("gen_plan.txt");
+				planOf << std::format(
+					"removed {} dead node(s), merged {} duplicate node(s)\ninterpreted: {} instruction(s), {} pass(es)\n",
+					m_deadNodeCount, m_mergedNodes.size(), program.instructions.size(), program.passes.size()
+				);
+				planOf.close();
+#endif
+
+				m_interpreting = true;
+				render();
+				return;
+			}
+			// doesn't fit the interpreter (registers, images...), generate it instead
+		}
+
+		RenderPlan plan{};
+
+		auto passes = planPasses();
+		m_planDescription = describePlan(passes);
+		std::string source = generateSource(passes, WorkGroupSize{}, plan);
+
+		// the shape only changes the layout line and the tile sizes, the default source identifies the program
+		resetTuning();
+		m_tuningKey = ShaderCache::hash(source);
+
+		auto& tunedSizes = tunedWorkGroupSizes().sizes;
+		auto tuned = tunedSizes.find(m_tuningKey);
+		if (tuned != tunedSizes.end()) {
+			if (tuned->second != WorkGroupSize{}) {
+				source = generateSource(passes, tuned->second, plan);
+			}
+		}
+		else {
+			for (const auto& size : g_WorkGroupCandidates) {
+				TuningCandidate candidate{};
+				candidate.source = generateSource(passes, size, candidate.plan);
+				m_tuning.push_back(std::move(candidate));
+			}
+		}
+
+#ifdef _DEBUG
+		std::ofstream of("gen.glsl");
+		of << source;
+		of.close();
+
+		std::ofstream planOf("gen_plan.txt");
+		planOf << m_planDescription;
+		planOf.close();
+#endif
+
+		// identical sources (undo, reconnecting a former topology) reuse the linked program
+		auto& cache = ShaderCache::shared();
+		if (auto shader = cache.find(source)) {
+			m_pendingShader.reset();
+			m_pendingSource.clear();
+
+			m_interpreting = false;
+			generatedShader = shader;
+			m_plan = std::move(plan);
+			render();
+		}
+		else if (source != m_pendingSource) {
+			// compiled in the background, the current program keeps rendering until update() swaps it in.
+			// a newer graph state simply replaces the one still compiling.
+			m_pendingSource = std::move(source);
+			m_pendingPlan = std::move(plan);
+
+			GpuProfiler::ScopedTimer compileTimer("compile");
+			m_pendingShader = cache.compile(m_pendingSource);
+		}
+	}
+
+	// Called every frame, swaps in the pending program once the driver is done with it.
+	void update() {
+		// params are uniforms and don't regenerate the shader, but merged nodes have to be split again,
+		// baked params updated and image formats redeclared
+		if (!editing() && changesNeedSolve()) {
+			solve();
+		}
+
+		if (!m_pendingShader) {
+			tuneWorkGroupSize();
+			return;
+		}
+		if (!m_pendingShader->linkCompleted()) return;
+
+		swapPendingShader();
+	}
+
+	// Waits for the program still compiling and renders with it, for renders that can't wait for update() (exports).
+	// False if it failed to compile, the previous program stays current.
+	bool finishCompile() {
+		return m_pendingShader ? swapPendingShader() : true;
+	}
+
+	// the interpreter renders instead of a generated program, see Backend
+	bool interpreting() const { return m_interpreting; }
+
+	void render(uint32_t width = 1024, uint32_t height = 1024) {
+		if (!m_interpreting && !generatedShader) return;
+
+		m_renderWidth = width;
+		m_renderHeight = height;
 
-	void solveFor(ShaderGen& gen, size_t nodeId, const std::string& funcName, bool appendFunctions = true, bool inclusive = true) {
-		if (m_nodePath.empty()) buildNodePath();
+		GpuProfiler::ScopedTimer timer("render");
+		renderNodes(width, height);
+		renderRegion(width, height, { 0, 0, width, height });
+	}
 
-		gen.beginFunctionBlock("vec4 tree_" + funcName + "(vec2 cUV)");
-		
-		std::string lib = "";
+	/*
+	 * Renders a width x height output one tile of at most tileSize² at a time, so the output and
+	 * intermediate images only have to hold a tile instead of the whole output. cUV stays relative
+	 * to the whole output. Multipass nodes sample their source around the current pixel, so each
+	 * tile is rendered with an apron of tileApron() pixels, enough for their reads to stay inside it.
+	 * The output textures are left holding the last tile, render() restores them.
+	 */
+	bool renderTiled(uint32_t width, uint32_t height, uint32_t tileSize, const TileWriter& write) {
+		if ((!m_interpreting && !generatedShader) || tileSize == 0) return false;
+
+		auto outputs = outputNodes();
+		renderNodes(width, height);
+
+		const uint32_t apron = tileApron();
+		for (uint32_t y = 0; y < height; y += tileSize) {
+			for (uint32_t x = 0; x < width; x += tileSize) {
+				const TileRegion tile{ x, y, std::min(tileSize, width - x), std::min(tileSize, height - y) };
+
+				TileRegion image{ x - std::min(x, apron), y - std::min(y, apron) };
+				image.width = std::min(x + tile.width + apron, width) - image.x;
+				image.height = std::min(y + tile.height + apron, height) - image.y;
+
+				renderRegion(width, height, image);
+
+				// the writer reads the outputs back
+				glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+				for (auto output : outputs) {
+					write(output, tile, image);
+				}
+			}
+		}
+		return true;
+	}
 
-		for (size_t i = m_nodePath.size(); i-- > 0;) {
-			auto node = dynamic_cast<GraphicsNode*>(get(m_nodePath[i]));
+	// Output nodes of the live graph, the ones render() writes
+	std::vector<OutputNode*> outputNodes() {
+		std::vector<OutputNode*> outputs;
+		for (const auto& nodeId : m_livePath) {
+			if (auto output = dynamic_cast<OutputNode*>(get(nodeId))) outputs.push_back(output);
+		}
+		return outputs;
+	}
 
-			// replace $ vars
-			std::string nodeLib = node->library();
-			nodeLib = std::regex_replace(nodeLib, std::regex("\\$NODE"), std::to_string(node->id()));
+	// Sum of the kernel radii along the longest chain of multipass nodes
+	uint32_t tileApron() {
+		std::unordered_map<Node*, uint32_t> reach;
+		uint32_t apron = 0;
+		for (const auto& nodeId : m_livePath) {
+			auto node = static_cast<GraphicsNode*>(get(nodeId));
 
-			// multipass nodes need a subtree function to sample from it multiple times
+			uint32_t r = 0;
+			for (const auto& conn : liveInputs(node)) {
+				r = std::max(r, reach[conn.source]);
+			}
 			if (node->multiPassNode()) {
-				std::string treeName = std::format("tree_sub_{}", node->id());
-				nodeLib = std::regex_replace(nodeLib, std::regex("\\$TREE"), treeName);
+				r += node->kernelRadius();
+			}
+
+			reach[node] = r;
+			apron = std::max(apron, r);
+		}
+		return apron;
+	}
+
+	// Binds the plan's images and runs every pass of the program over region
+	void dispatch(Shader& shader, const RenderPlan& plan, uint32_t width, uint32_t height, const TileRegion& region) {
+		glUseProgram(shader.id());
+		shader.uniform<2>("bOutputSize", { float(width), float(height) });
+		shader.uniformInt<2>("bTileOffset", { int(region.x), int(region.y) });
 
-				if (m_subtreeNames.find(node->id()) == m_subtreeNames.end()) {
-					m_subtreeNames[node->id()] = treeName;
+		{
+			GpuProfiler::ScopedTimer timer("uniforms");
+			bindImages(shader, plan, region.width, region.height);
 
-					ShaderGen subtreeGen{};
-					solveFor(subtreeGen, node->id(), std::format("sub_{}", node->id()), false, false);
+			if (!plan.baked) {
+				setUniforms(shader);
+			}
+		}
+
+		// round up, the invocations past the edges return early (see generatePass)
+		const auto& size = plan.workGroupSize;
+		for (size_t pass = 0; pass < plan.passCount; pass++) {
+			GpuProfiler::ScopedTimer timer("pass", pass);
+			shader.uniformInt<1>("bPass", { int(pass) });
+
+			glDispatchCompute((region.width + size.x - 1) / size.x, (region.height + size.y - 1) / size.y, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+	}
+
+	// Runs the uploaded program over region, with the current param values
+	void interpret(uint32_t width, uint32_t height, const TileRegion& region) {
+		auto shader = m_interpreter.shader();
+		if (!shader) return;
+
+		glUseProgram(shader->id());
+		shader->uniform<2>("bOutputSize", { float(width), float(height) });
+		shader->uniformInt<2>("bTileOffset", { int(region.x), int(region.y) });
+
+		{
+			GpuProfiler::ScopedTimer timer("uniforms");
+			bindImages(*shader, m_interpreterPlan, region.width, region.height);
+
+			std::vector<RawValue> constants{ RawValue{} };
+			for (const auto& [nodeId, param] : m_interpreterConstants) {
+				auto node = static_cast<GraphicsNode*>(get(nodeId));
+				constants.push_back(node ? node->param(param).value : RawValue{});
+			}
+			m_interpreter.uploadConstants(constants);
+		}
 
-					m_subtreeFunctions[node->id()] = subtreeGen.target(ShaderGen::Target::definitions);
+		GpuProfiler::ScopedTimer timer("interpret");
+		m_interpreter.dispatch(*shader, region.width, region.height);
+	}
+
+	// let nodes update their resources (webcam frames...) before binding them
+	void renderNodes(uint32_t width, uint32_t height) {
+		for (const auto& nodeId : m_livePath) {
+			auto node = static_cast<GraphicsNode*>(get(nodeId));
+			if (!dynamic_cast<OutputNode*>(node)) {
+				node->render(width, height);
+			}
+		}
+	}
+
+	// region of a width x height output, the output and intermediate images are region sized
+	void renderRegion(uint32_t width, uint32_t height, const TileRegion& region) {
+		if (m_interpreting) {
+			interpret(width, height, region);
+			return;
+		}
+		dispatch(*generatedShader, m_plan, width, height, region);
+	}
+
+	void bindImages(Shader& shader, const RenderPlan& plan, uint32_t width, uint32_t height) {
+		for (size_t binding = 0; binding < plan.bindings.size(); binding++) {
+			const auto& img = plan.bindings[binding];
+			auto node = static_cast<GraphicsNode*>(get(img.nodeId));
+			if (!node) continue; // removed while its program was still in use
+
+			switch (img.kind) {
+				case ImageBinding::Kind::output: node->render(width, height, binding); break;
+				case ImageBinding::Kind::param: {
+					const GLenum internalFormat = storageFormatInfo(storageFormatOf(node)).internalFormat;
+					setUniform(shader, paramUniformName(node, img.param), node->param(img.param), binding, internalFormat);
+				} break;
+				case ImageBinding::Kind::intermediate: {
+					auto& image = intermediateImage(img.index, width, height);
+					glBindImageTexture(binding, image.id(), 0, false, 0, GL_READ_WRITE, GL_RGBA32F);
+				} break;
+			}
+		}
+	}
+
+	/*
+	 * Graph optimization before codegen:
+	 *  - nodes from which no Output node can be reached are dropped,
+	 *  - nodes of the same type, with the same params and the same (already merged) input sources
+	 *    are merged into the first one, their consumers read its outputs instead.
+	 * Node ids are not changed, the result is m_livePath and the rewritten connections.
+	 */
+	void optimizeGraph() {
+		m_livePath.clear();
+		m_liveInputs.clear();
+		m_liveOutputs.clear();
+		m_mergedNodes.clear();
+		m_deadNodeCount = 0;
+
+		std::unordered_set<Node*> live;
+		std::vector<Node*> stack;
+		for (const auto& nodeId : m_nodePath) {
+			auto node = get(nodeId);
+			if (dynamic_cast<OutputNode*>(node)) {
+				live.insert(node);
+				stack.push_back(node);
+			}
+		}
+
+		while (!stack.empty()) {
+			Node* node = stack.back(); stack.pop_back();
+			for (const auto& conn : getNodeInputConnections(node)) {
+				if (live.insert(conn.source).second) {
+					stack.push_back(conn.source);
+				}
+			}
+		}
+
+		// in path order, the sources of a node are merged before the node itself is hashed
+		std::unordered_map<std::string, Node*> structures;
+		std::unordered_map<Node*, Node*> replacements;
+		for (const auto& nodeId : m_nodePath) {
+			auto node = static_cast<GraphicsNode*>(get(nodeId));
+			if (!live.contains(node)) {
+				m_deadNodeCount++;
+				continue;
+			}
+
+			std::vector<Connection> inputs(getNodeInputConnections(node).begin(), getNodeInputConnections(node).end());
+			for (auto& conn : inputs) {
+				if (auto it = replacements.find(conn.source); it != replacements.end()) {
+					conn.source = it->second;
+				}
+			}
+
+			// Output nodes each write their own image
+			if (!dynamic_cast<OutputNode*>(node)) {
+				auto [it, inserted] = structures.try_emplace(structureKey(node, inputs), node);
+				if (!inserted) {
+					replacements[node] = it->second;
+					m_mergedNodes.push_back({ node->id(), it->second->id() });
+					continue;
 				}
 			}
 
+			m_livePath.push_back(nodeId);
+			for (const auto& conn : inputs) {
+				m_liveOutputs[conn.source].push_back(conn);
+			}
+			m_liveInputs[node] = std::move(inputs);
+		}
+	}
+
+	// (type, params, input sources) of a node, equal keys compute the same values
+	static std::string structureKey(GraphicsNode* node, std::vector<Connection> inputs) {
+		std::sort(inputs.begin(), inputs.end(), [](const auto& a, const auto& b) { return a.destinationInput < b.destinationInput; });
+
+		std::string key = typeid(*node).name();
+		key += paramsKey(node);
+		for (const auto& conn : inputs) {
+			key += std::format("|{}<{}:{}", conn.destinationInput, conn.source->id(), conn.sourceOutput);
+		}
+		return key;
+	}
+
+	static std::string paramsKey(GraphicsNode* node) {
+		std::string key = "";
+		for (const auto& [name, nv] : node->params()) {
+			key += std::format("|{}:{}={},{},{},{}", name, size_t(nv.type), nv.value[0], nv.value[1], nv.value[2], nv.value[3]);
+		}
+		return key;
+	}
+
+	// Whether the nodes edited since the last call (see Node::markChanged) need a new program
+	bool changesNeedSolve() {
+		bool needed = false;
+		for (Node* node : takeChangedNodes()) {
+			// the baked program has the params of the live nodes as constants
+			if (m_shaderMode == ShaderMode::baked && m_liveInputs.contains(node)) {
+				needed = true;
+				continue;
+			}
+
+			if (mergeDiverged(node)) {
+				needed = true;
+				continue;
+			}
+
+			auto format = m_storageFormats.find(node->id());
+			if (format != m_storageFormats.end() && format->second != storageFormatOf(static_cast<GraphicsNode*>(node))) {
+				needed = true;
+			}
+		}
+		return needed;
+	}
+
+	static StorageFormat storageFormatOf(GraphicsNode* node) {
+		if (auto output = dynamic_cast<OutputNode*>(node)) return output->format;
+		if (auto image = dynamic_cast<ImageNode*>(node)) return image->format;
+		return StorageFormat::rgba32f;
+	}
+
+	// whether the node was merged with another (or another into it) and their params differ now
+	bool mergeDiverged(Node* node) {
+		for (const auto& [removedId, keptId] : m_mergedNodes) {
+			if (removedId != node->id() && keptId != node->id()) continue;
+
+			auto removed = static_cast<GraphicsNode*>(get(removedId));
+			auto kept = static_cast<GraphicsNode*>(get(keptId));
+			if (removed && kept && paramsKey(removed) != paramsKey(kept)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::span<const Connection> liveInputs(Node* node) const {
+		auto it = m_liveInputs.find(node);
+		if (it == m_liveInputs.end()) return {};
+		return it->second;
+	}
+
+	std::span<const Connection> liveOutputs(Node* node) const {
+		auto it = m_liveOutputs.find(node);
+		if (it == m_liveOutputs.end()) return {};
+		return it->second;
+	}
+
+	const Connection* liveInputTo(Node* node, size_t input) const {
+		for (const auto& conn : liveInputs(node)) {
+			if (conn.destinationInput == input) return &conn;
+		}
+		return nullptr;
+	}
+
+	/*
+	 * Chooses which node outputs are rendered to intermediate images.
+	 * Multipass sources always are. Then, while it pays off, the node evaluated by the most
+	 * redundant passes gets a pass of its own: computing it once saves (passes - 1) evaluations
+	 * of it and of everything it inlines, for one store, a fetch per consumer pass and a dispatch.
+	 * Cheap chains stay fused into their consumers.
+	 */
+	std::vector<RenderPass> planPasses() {
+		m_materialized.clear();
+		for (const auto& nodeId : m_livePath) {
+			if (auto source = multipassSource(static_cast<GraphicsNode*>(get(nodeId)))) {
+				m_materialized[{ source->source->id(), source->sourceOutput }] = MaterializeReason::multipass;
+			}
+		}
+
+		auto passes = buildPasses();
+
+		for (size_t iteration = 0; iteration < m_livePath.size(); iteration++) {
+			std::unordered_map<Node*, size_t> uses;
+			for (const auto& pass : passes) {
+				for (Node* node : pass.nodes) uses[node]++;
+			}
+
+			Node* best = nullptr;
+			float bestGain = 0.0f;
+			for (const auto& nodeId : m_livePath) { // in path order, so ties always resolve the same way
+				Node* node = get(nodeId);
+				size_t passCount = uses[node];
+				if (passCount < 2) continue;
+
+				std::set<size_t> outputs;
+				for (const auto& conn : liveOutputs(node)) outputs.insert(conn.sourceOutput);
+
+				float saved = float(passCount - 1) * subtreeCost(node);
+				float spent = g_PassCost + float(outputs.size()) * (g_StoreCost + float(passCount) * g_FetchCost);
+				if (saved - spent > bestGain) {
+					bestGain = saved - spent;
+					best = node;
+				}
+			}
+
+			if (!best) break;
+
+			for (const auto& conn : liveOutputs(best)) {
+				m_materialized.try_emplace({ best->id(), conn.sourceOutput }, MaterializeReason::shared);
+			}
+			passes = buildPasses();
+		}
+
+		return passes;
+	}
+
+	// One pass per materialized node, in execution order, then the last pass
+	std::vector<RenderPass> buildPasses() {
+		std::vector<RenderPass> passes;
+
+		for (const auto& nodeId : m_livePath) {
+			RenderPass pass{};
+			for (auto it = m_materialized.lower_bound({ nodeId, 0 }); it != m_materialized.end() && it->first.first == nodeId; ++it) {
+				pass.outputs.push_back(it->first.second);
+			}
+			if (pass.outputs.empty()) continue;
+
+			pass.root = get(nodeId);
+			pass.nodes = collectPassNodes({ pass.root });
+			passes.push_back(pass);
+		}
+
+		// the last pass evaluates everything that doesn't feed another node
+		std::vector<Node*> sinks;
+		for (const auto& nodeId : m_livePath) {
+			auto node = get(nodeId);
+			if (liveOutputs(node).empty()) {
+				sinks.push_back(node);
+			}
+		}
+		passes.push_back({ .nodes = collectPassNodes(sinks) });
+
+		for (auto& pass : passes) {
+			pass.cost = passCost(pass);
+		}
+		return passes;
+	}
+
+	std::string describePlan(const std::vector<RenderPass>& passes) {
+		static const char* reasons[] = { "multipass", "shared" };
+
+		std::string out = std::format("removed {} dead node(s), merged {} duplicate node(s)\n", m_deadNodeCount, m_mergedNodes.size());
+		float total = 0.0f;
+		for (size_t i = 0; i < passes.size(); i++) {
+			const auto& pass = passes[i];
+			total += pass.cost;
+
+			out += std::format("pass {}: cost {:.1f}, nodes [", i, pass.cost);
+			for (size_t j = 0; j < pass.nodes.size(); j++) {
+				out += std::format(j > 0 ? ", {}" : "{}", pass.nodes[j]->id());
+			}
+			out += "]";
+
+			for (size_t output : pass.outputs) {
+				auto reason = m_materialized[{ pass.root->id(), output }];
+				out += std::format(", stores {}:{} ({})", pass.root->id(), output, reasons[size_t(reason)]);
+			}
+			out += "\n";
+		}
+		out += std::format("total cost {:.1f} per pixel\n", total);
+		return out;
+	}
+
+	std::string generateSource(const std::vector<RenderPass>& passes, const WorkGroupSize& size, RenderPlan& plan) {
+		ShaderGen gen{};
+		gen.setWorkGroupSize(size);
+
+		plan = {};
+		generate(gen, passes, plan);
+		return gen.generate();
+	}
+
+	void generate(ShaderGen& gen, const std::vector<RenderPass>& passes, RenderPlan& plan) {
+		plan.workGroupSize = gen.workGroupSize();
+		plan.baked = m_shaderMode == ShaderMode::baked;
+		std::unordered_set<Node*> used;
+		for (const auto& pass : passes) {
+			used.insert(pass.nodes.begin(), pass.nodes.end());
+		}
+
+		// intermediate images
+		for (const auto& [key, reason] : m_materialized) {
+			auto [nodeId, output] = key;
+			auto imgName = std::format("bMat_{}_{}", nodeId, output);
+
+			gen.beginCodeBlock();
+			gen.append(std::format("layout (rgba32f, binding={}) uniform image2D {};\n", plan.bindings.size(), imgName));
+			gen.endCodeBlock(ShaderGen::Target::uniforms);
+
+			plan.bindings.push_back({
+				.kind = ImageBinding::Kind::intermediate,
+				.nodeId = nodeId,
+				.index = plan.intermediateCount++
+			});
+
+			gen.beginCodeBlock();
+			gen.append(std::format(
+				"vec4 mat_{}_{}(vec2 uv) {{\n\tivec2 size = imageSize({});\n\treturn imageLoad({}, clamp(TileCoords(uv), ivec2(0), size - 1));\n}}\n\n",
+				nodeId, output, imgName, imgName
+			));
+			gen.endCodeBlock(ShaderGen::Target::definitions);
+		}
+
+		// kernel nodes get their source tile in shared memory, as long as it fits
+		m_tiledKernels.clear();
+		size_t sharedBytes = 0;
+		for (const auto& nodeId : m_livePath) {
+			auto node = static_cast<GraphicsNode*>(get(nodeId));
+			if (!used.contains(node) || node->kernelRadius() == 0 || !multipassSource(node)) continue;
+
+			const auto& size = gen.workGroupSize();
+			size_t bytes = (size.x + 2 * node->kernelRadius()) * (size.y + 2 * node->kernelRadius()) * sizeof(float) * 4;
+			if (sharedBytes + bytes > g_SharedMemoryBudget) continue;
+
+			sharedBytes += bytes;
+			m_tiledKernels.insert(nodeId);
+		}
+
+		// declarations
+		for (size_t i = m_livePath.size(); i-- > 0;) {
+			auto node = static_cast<GraphicsNode*>(get(m_livePath[i]));
+			if (!used.contains(node)) continue;
+
+			// multipass nodes sample their source through a subtree function
+			std::string treeName;
+			if (node->multiPassNode()) {
+				treeName = std::format("tree_sub_{}", node->id());
+
+				gen.beginCodeBlock();
+				if (auto source = multipassSource(node); source && m_tiledKernels.contains(node->id())) {
+					appendKernelTile(gen, node, *source);
+				}
+				else if (source) {
+					gen.append(std::format("vec4 {}(vec2 uv) {{ return mat_{}_{}(uv); }}\n\n", treeName, source->source->id(), source->sourceOutput));
+				}
+				else {
+					gen.append(std::format("vec4 {}(vec2 uv) {{ return vec4(0.0); }}\n\n", treeName));
+				}
+				gen.endCodeBlock(ShaderGen::Target::definitions);
+			}
+
 			// Output nodes
 			if (dynamic_cast<OutputNode*>(node)) {
 				gen.beginCodeBlock();
-				gen.append(std::format("layout (rgba32f, binding={}) uniform image2D bOutput{};\n", m_imgId++, node->id()));
+				auto qualifier = storageFormatInfo(storageFormatOf(node)).qualifier;
+				gen.append(std::format("layout ({}, binding={}) uniform image2D bOutput{};\n", qualifier, plan.bindings.size(), node->id()));
 				gen.endCodeBlock(ShaderGen::Target::uniforms);
+
+				plan.bindings.push_back({ .kind = ImageBinding::Kind::output, .nodeId = node->id() });
 			}
 
-			// load libraries
-			lib += nodeLib;
-			lib += "\n";
+			// load libraries, filling in the $ vars (parsed once per node type, see ShaderLibrary)
+			gen.loadLib(node->libraryTemplate(), node->id(), treeName);
 
 			// do the same for params
 			for (auto& [paramName, nv] : node->params()) {
+				if (plan.baked && nv.type != ValueType::image) {
+					gen.appendConstant(nv.type, paramUniformName(node, paramName), nv.value);
+					continue;
+				}
+
 				// uniforms
-				auto uniName = std::format("param_{}_{}", node->id(), toCamelCase(paramName));
-				gen.appendUniform(nv.type, uniName, nv.type == ValueType::image ? (m_imgId++) : 0);
+				size_t binding = 0;
+				if (nv.type == ValueType::image) {
+					binding = plan.bindings.size();
+					plan.bindings.push_back({ .kind = ImageBinding::Kind::param, .nodeId = node->id(), .param = paramName });
+				}
+				gen.appendUniform(nv.type, paramUniformName(node, paramName), binding, storageFormatInfo(storageFormatOf(node)).qualifier);
 			}
+		}
 
-			// declare outputs
-			for (size_t i = 0; i < node->outputCount(); i++) {
-				auto& nv = node->texture(i);
+		for (size_t i = 0; i < passes.size(); i++) {
+			generatePass(gen, i, passes[i]);
+		}
+		plan.passCount = passes.size();
 
-				auto varName = std::format("out_{}_{}", node->id(), i);
+		gen.beginCodeBlock();
+		gen.indent();
+		gen.append("switch (bPass) {\n");
+		for (size_t i = 0; i < passes.size(); i++) {
+			gen.indent();
+			gen.append(std::format("\tcase {}: pass_{}(cUV); break;\n", i, i));
+		}
+		gen.indent();
+		gen.append("}");
+		gen.endCodeBlock(ShaderGen::Target::body);
+	}
 
-				gen.indent();
-				gen.appendVariable(nv.type, varName);
-				gen.append(";\n");
+	/*
+	 * Compiles the live graph for the interpreter (see GraphInterpreter).
+	 * Only multipass sources get a pass of their own. Within a pass each node gets a block of
+	 * registers for its outputs, freed after its last consumer. Fails when the graph needs more
+	 * registers or images than the interpreter has, or a node type it doesn't know.
+	 */
+	bool buildProgram(GraphInterpreter::Program& program, RenderPlan& plan, std::vector<std::pair<size_t, std::string>>& constants) {
+		using Kind = GraphInterpreter::OperandKind;
+
+		program = {};
+		plan = {};
+		constants.clear();
+
+		m_materialized.clear();
+		for (const auto& nodeId : m_livePath) {
+			if (auto source = multipassSource(static_cast<GraphicsNode*>(get(nodeId)))) {
+				m_materialized[{ source->source->id(), source->sourceOutput }] = MaterializeReason::multipass;
 			}
 		}
+		auto passes = buildPasses();
+		plan.passCount = passes.size();
+
+		std::map<std::pair<size_t, size_t>, uint32_t> images; // materialized output -> image
+		for (const auto& [output, reason] : m_materialized) {
+			images[output] = uint32_t(plan.bindings.size());
+			plan.bindings.push_back({
+				.kind = ImageBinding::Kind::intermediate,
+				.nodeId = output.first,
+				.index = plan.intermediateCount++
+			});
+		}
 
-		gen.loadLib(lib);
-
-		// call functions
-		std::stack<Node*> nodes;
+		std::map<std::pair<size_t, std::string>, uint32_t> constantIndices;
+		auto constant = [&](GraphicsNode* node, const std::string& param) {
+			auto [it, inserted] = constantIndices.try_emplace({ node->id(), param }, uint32_t(constants.size() + 1));
+			if (inserted) constants.push_back({ node->id(), param });
+			return it->second;
+		};
 
-		// find stop pos
-		auto stopPosIter = std::find(m_nodePath.begin(), m_nodePath.end(), nodeId);
-		auto stopPos = std::distance(m_nodePath.begin(), stopPosIter);
-		if (inclusive) stopPos++;
+		const uint32_t uv = GraphInterpreter::operand(Kind::uv, ValueType::vec2, 0);
+		auto zero = [](ValueType type) { return GraphInterpreter::operand(Kind::constant, type, 0); };
 
-		for (size_t i = stopPos; i-- > 0;) {
-			nodes.push(get(m_nodePath[i]));
-		}
+		for (const auto& pass : passes) {
+			const uint32_t begin = uint32_t(program.instructions.size());
 
-		Node* lastNode = nullptr;
-		while (!nodes.empty()) {
-			auto node = static_cast<GraphicsNode*>(nodes.top()); nodes.pop();
-			if (nodes.empty()) {
-				lastNode = node;
+			// index of the last node reading each node in the pass, the root is read by the stores
+			std::unordered_map<Node*, size_t> lastUse;
+			for (size_t i = 0; i < pass.nodes.size(); i++) {
+				for (const auto& conn : liveInputs(pass.nodes[i])) {
+					if (!isMaterialized(conn)) lastUse[conn.source] = i;
+				}
 			}
+			if (pass.root) lastUse[pass.root] = pass.nodes.size();
+
+			std::vector<bool> used(GraphInterpreter::g_RegisterCount, false);
+			std::unordered_map<Node*, uint32_t> registers; // first output register
+
+			auto registerOperand = [&](const Connection& conn) {
+				auto type = conn.source->texture(conn.sourceOutput).type;
+				return GraphInterpreter::operand(Kind::reg, type, registers[conn.source] + uint32_t(conn.sourceOutput));
+			};
+
+			auto connectionOperand = [&](const Connection& conn, std::vector<uint32_t>& words) {
+				if (isMaterialized(conn)) {
+					auto type = conn.source->texture(conn.sourceOutput).type;
+					const uint32_t image = images[{ conn.source->id(), conn.sourceOutput }];
+					words.push_back(GraphInterpreter::operand(Kind::image, type, image | GraphInterpreter::g_TileImageBit));
+					words.push_back(uv);
+				}
+				else {
+					words.push_back(registerOperand(conn));
+					words.push_back(0);
+				}
+			};
+
+			auto emit = [&](uint32_t op, uint32_t dst, uint32_t aux, const std::vector<uint32_t>& words) {
+				program.instructions.push_back({ .op = op, .dst = dst, .operands = uint32_t(program.operands.size()), .aux = aux });
+				program.operands.insert(program.operands.end(), words.begin(), words.end());
+			};
+
+			// frees what the i-th node was the last one to read
+			auto release = [&](Node* node, size_t i) {
+				for (const auto& conn : liveInputs(node)) {
+					auto it = registers.find(conn.source);
+					if (it == registers.end() || lastUse[conn.source] != i) continue;
+					std::fill(used.begin() + it->second, used.begin() + it->second + conn.source->outputCount(), false);
+				}
+			};
+
+			for (size_t i = 0; i < pass.nodes.size(); i++) {
+				auto node = static_cast<GraphicsNode*>(pass.nodes[i]);
+				std::vector<uint32_t> words;
+
+				// bImages is a single rgba32f array
+				if (storageFormatOf(node) != StorageFormat::rgba32f) return false;
 
-			auto nodeFunction = std::regex_replace(node->functionName(), std::regex("\\$NODE"), std::to_string(node->id()));
+				if (dynamic_cast<OutputNode*>(node)) {
+					const uint32_t image = uint32_t(plan.bindings.size());
+					plan.bindings.push_back({ .kind = ImageBinding::Kind::output, .nodeId = node->id() });
 
-			// a
-			if (appendFunctions) {
-				if (node->multiPassNode() && m_subtreeFunctions.find(node->id()) != m_subtreeFunctions.end()) {
-					gen.beginCodeBlock();
-					gen.append(m_subtreeFunctions[node->id()]);
-					gen.endCodeBlock(ShaderGen::Target::definitions);
+					if (auto con = liveInputTo(node, 0)) connectionOperand(*con, words);
+					else words.insert(words.end(), { zero(ValueType::vec4), 0 });
+
+					emit(GraphInterpreter::g_StoreOp, 0, image, words);
+					release(node, i);
+					continue;
 				}
-				gen.pasteFunction(nodeFunction, lib);
-			}
 
-			gen.indent();
-			gen.append(std::format("{}(", nodeFunction));
-
-			// b
-			auto nodeParams = node->parameters();
-			auto fn = gen.getFunction(nodeFunction);
-
-			size_t i = 0;
-			for (auto&& param : fn.parameterOrder) {
-				auto paramOb = fn.parameters[param];
-				if (paramOb.qualifier == ShaderFunctionParam::out) continue;
-
-				// i
-				auto [inputParamName, sType] = nodeParams[param];
-				bool appendComma = false;
-
-				// ii
-				if (node->hasInput(inputParamName)) {
-					auto conns = getConnectionsToInput(node, node->inputIndex(inputParamName));
-					if (!conns.empty()) { // connected
-						// TODO: Consider multiple connections to the same output-input pair, maybe an average?
-						//       might give some problems when dealing with different types...
-						auto&& con = conns.front();
-						auto&& nv = con.source->texture(con.sourceOutput);
-						gen.convertType(
-							nv.type,
-							paramOb.type,
-							std::format("out_{}_{}", con.source->id(), con.sourceOutput)
-						);
-						appendComma = true;
+				const uint32_t op = m_interpreter.opOf(node);
+				if (op == GraphInterpreter::g_StoreOp) return false;
+
+				// operands in the order emitNodeCall passes the arguments, resolved the same way
+				auto nodeParams = node->parameters();
+				const auto& fn = m_interpreter.signature(op);
+				for (const auto& param : fn.parameterOrder) {
+					const auto& paramOb = fn.parameters.at(param);
+					if (paramOb.qualifier == ShaderFunctionParam::out) continue;
+
+					auto [inputParamName, sType] = nodeParams[param];
+
+					// the texture coordinates input, if the node has one
+					bool hasUvs = false;
+					const Connection* uvs = nullptr;
+					for (const auto& [fnParam, ndParam] : nodeParams) {
+						if (ndParam.second == SpecialType::textureCoords) {
+							hasUvs = true;
+							uvs = liveInputTo(node, node->inputIndex(ndParam.first));
+							break;
+						}
+					}
+
+					const Connection* con = node->hasInput(inputParamName) ? liveInputTo(node, node->inputIndex(inputParamName)) : nullptr;
+					if (con) {
+						connectionOperand(*con, words);
+					}
+					else if (node->hasParam(inputParamName)) {
+						auto&& nv = node->param(inputParamName);
+						if (nv.type == ValueType::image) {
+							const uint32_t image = uint32_t(plan.bindings.size());
+							plan.bindings.push_back({ .kind = ImageBinding::Kind::param, .nodeId = node->id(), .param = inputParamName });
+
+							// sampled at a value the interpreter can fetch directly
+							if (uvs && isMaterialized(*uvs)) return false;
+							words.push_back(GraphInterpreter::operand(Kind::image, ValueType::vec4, image));
+							words.push_back(uvs ? registerOperand(*uvs) : uv);
+						}
+						else {
+							words.push_back(GraphInterpreter::operand(Kind::constant, nv.type, constant(node, inputParamName)));
+							words.push_back(0);
+						}
+					}
+					else if (inputParamName == "cUV") {
+						words.insert(words.end(), { uv, 0 });
+					}
+					else if (hasUvs) {
+						if (uvs) connectionOperand(*uvs, words);
+						else words.insert(words.end(), { uv, 0 });
 					}
 					else {
-						// iii
-						appendComma = checkParams(gen, node, inputParamName, sType, paramOb.type);
+						words.insert(words.end(), { zero(paramOb.type), 0 });
 					}
 				}
-				// iii
-				else {
-					appendComma = checkParams(gen, node, inputParamName, sType, paramOb.type);
-				}
 
-				if (appendComma && i < fn.parameterOrder.size() - 1) {
-					gen.append(", ");
+				// first fit block for the outputs
+				const uint32_t count = uint32_t(node->outputCount());
+				uint32_t dst = 0;
+				while (dst + count <= GraphInterpreter::g_RegisterCount && std::any_of(used.begin() + dst, used.begin() + dst + count, [](bool u) { return u; })) {
+					dst++;
 				}
+				if (dst + count > GraphInterpreter::g_RegisterCount) return false;
 
-				i++;
-			}
+				std::fill(used.begin() + dst, used.begin() + dst + count, true);
+				registers[node] = dst;
 
-			// c
-			if (node->outputCount() > 0) {
-				for (size_t i = 0; i < node->outputCount(); i++) {
-					auto& nv = node->texture(i);
-					auto varName = std::format("out_{}_{}", node->id(), i);
-					gen.append(varName);
-					if (i < node->outputCount() - 1) {
-						gen.append(", ");
-					}
+				uint32_t aux = 0; // image sampled by $TREE
+				if (auto source = multipassSource(node)) {
+					aux = images[{ source->source->id(), source->sourceOutput }];
 				}
+				emit(op, dst, aux, words);
+				release(node, i);
 			}
 
-			gen.append(");\n");
+			for (size_t output : pass.outputs) {
+				auto type = pass.root->texture(output).type;
+				emit(
+					GraphInterpreter::g_StoreOp, 0, images[{ pass.root->id(), output }],
+					{ GraphInterpreter::operand(Kind::reg, type, registers[pass.root] + uint32_t(output)), 0 }
+				);
+			}
+
+			program.passes.push_back({ begin, uint32_t(program.instructions.size()) });
 		}
 
-		// output the last node output by default
-		if (lastNode && !dynamic_cast<OutputNode*>(lastNode)) {
-			gen.indent();
+		return plan.bindings.size() <= GraphInterpreter::g_ImageCount;
+	}
+
+	/*
+	 * Shared memory tile of a kernel node's source: the workgroup's texels plus an apron of
+	 * kernelRadius() on each side. load_tile_N() fills it cooperatively (each texel fetched once per
+	 * workgroup instead of once per tap), and tree_sub_N reads from it, falling back to the image for
+	 * taps outside the tile.
+	 */
+	void appendKernelTile(ShaderGen& gen, GraphicsNode* node, const Connection& source) {
+		const size_t id = node->id();
+		const uint32_t radius = node->kernelRadius();
+		auto imgName = std::format("bMat_{}_{}", source.source->id(), source.sourceOutput);
+
+		gen.append(std::format("#define TILE_{}_SIZE (gl_WorkGroupSize.xy + uvec2({}))\n", id, radius * 2));
+		gen.append(std::format("shared vec4 tile_{}[TILE_{}_SIZE.y][TILE_{}_SIZE.x];\n\n", id, id, id));
+
+		gen.append(std::format("ivec2 tile_{}_origin() {{ return ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) - ivec2({}); }}\n\n", id, radius));
+
+		gen.append(std::format("void load_tile_{}() {{\n", id));
+		gen.append(std::format("\tivec2 size = imageSize({});\n", imgName));
+		gen.append(std::format("\tivec2 origin = tile_{}_origin();\n", id));
+		gen.append(std::format("\tfor (uint i = gl_LocalInvocationIndex; i < TILE_{}_SIZE.x * TILE_{}_SIZE.y; i += gl_WorkGroupSize.x * gl_WorkGroupSize.y) {{\n", id, id));
+		gen.append(std::format("\t\tivec2 t = ivec2(i % TILE_{}_SIZE.x, i / TILE_{}_SIZE.x);\n", id, id));
+		gen.append(std::format("\t\ttile_{}[t.y][t.x] = imageLoad({}, clamp(origin + t, ivec2(0), size - 1));\n", id, imgName));
+		gen.append("\t}\n}\n\n");
+
+		gen.append(std::format("vec4 tree_sub_{}(vec2 uv) {{\n", id));
+		gen.append(std::format("\tivec2 size = imageSize({});\n", imgName));
+		gen.append("\tivec2 t = clamp(TileCoords(uv), ivec2(0), size - 1);\n");
+		gen.append(std::format("\tivec2 local = t - tile_{}_origin();\n", id));
+		gen.append(std::format("\tif (all(greaterThanEqual(local, ivec2(0))) && all(lessThan(local, ivec2(TILE_{}_SIZE)))) {{\n", id));
+		gen.append(std::format("\t\treturn tile_{}[local.y][local.x];\n\t}}\n", id));
+		gen.append(std::format("\treturn imageLoad({}, t);\n}}\n\n", imgName));
+	}
+
+	void generatePass(ShaderGen& gen, size_t index, const RenderPass& pass) {
+		gen.beginFunctionBlock(std::format("void pass_{}(vec2 cUV)", index));
+
+		// declare outputs
+		for (Node* node : pass.nodes) {
+			for (size_t i = 0; i < node->outputCount(); i++) {
+				auto& nv = node->texture(i);
 
-			auto varName = std::format("out_{}_{}", lastNode->id(), 0);
-			gen.append("return ");
-			gen.convertType(lastNode->outputCount() > 0 ? lastNode->texture(0).type : ValueType::vec4, ValueType::vec4, varName);
-			gen.append(";\n");
+				auto varName = std::format("out_{}_{}", node->id(), i);
+
+				gen.indent();
+				gen.appendVariable(nv.type, varName);
+				gen.append(";\n");
+			}
 		}
-		else {
+
+		// fill the shared memory tiles, every invocation of the workgroup takes part
+		bool tiles = false;
+		for (Node* node : pass.nodes) {
+			if (m_tiledKernels.contains(node->id())) {
+				gen.indent();
+				gen.append(std::format("load_tile_{}();\n", node->id()));
+				tiles = true;
+			}
+		}
+		if (tiles) {
+			gen.indent();
+			gen.append("memoryBarrierShared();\n");
 			gen.indent();
-			gen.append("return vec4(0.0);\n");
+			gen.append("barrier();\n");
 		}
 
-		gen.endFunctionBlock(ShaderGen::Target::definitions);
-	}
+		// the dispatch is rounded up to whole workgroups, only past the barriers can the extra invocations leave
+		gen.indent();
+		gen.append("if (any(greaterThanEqual(ivec2(gl_GlobalInvocationID.xy) + bTileOffset, ivec2(bOutputSize)))) return;\n");
 
-	void solve() override {
-		ShaderGen gen{};
+		// call functions
+		for (Node* node : pass.nodes) {
+			emitNodeCall(gen, static_cast<GraphicsNode*>(node));
+		}
 
-		m_imgId = 0;
-		m_subtreeNames.clear();
-		m_subtreeFunctions.clear();
-
-		if (m_nodePath.empty()) buildNodePath();
-		solveFor(gen, m_nodePath.back(), "main"); // last node of the graph
-		
-		/*
-		* The nodes are already ordered by execution priority, that is the "node path"
-		* While the node stack is not empty:
-		*	a. Output the function name to the shader source
-		*	b. For each parameter in the function (fetched from the function library for the correct order)
-		*		i. Get the input/param name from the parameter map that the node provides
-		*		ii. If the parameter is a node input
-		*			- is it connected? get the value from the output of the node connected to this input and emit a converted value
-		*			- is it not connected? continue to step (iii)
-		*		iii. If the parameter is a node param
-		*			- emit a converted value
-		*		iv.  Otherwise
-		*			- check for builtins
-		*			- emit a default value otherwise
-		*	c. Emit the output parameters
-		*/
-
-		// output the shader itself
-
-		auto fnNameCall = std::format("tree_{}(cUV);", "main");
+		// store the materialized outputs
+		for (size_t output : pass.outputs) {
+			auto&& nv = pass.root->texture(output);
+			auto imgName = std::format("bMat_{}_{}", pass.root->id(), output);
 
-		gen.beginCodeBlock();
-		gen.indent();
-		gen.append(fnNameCall);
-		gen.endCodeBlock(ShaderGen::Target::body);
+			gen.indent();
+			gen.append(std::format("imageStore({}, TileCoords(cUV), ", imgName));
+			gen.convertType(nv.type, ValueType::vec4, std::format("out_{}_{}", pass.root->id(), output));
+			gen.append(");\n");
+		}
 
-		std::ofstream of("gen.glsl");
-		of << gen.generate();
-		of.close();
+		gen.endFunctionBlock(ShaderGen::Target::definitions);
+	}
 
-		if (generatedShader) {
-			generatedShader.reset();
-		}
+	/*
+	* For each node, in execution order:
+	*	a. Output the function name to the shader source
+	*	b. For each parameter in the function (fetched from the function library for the correct order)
+	*		i. Get the input/param name from the parameter map that the node provides
+	*		ii. If the parameter is a node input
+	*			- is it connected? get the value from the output of the node connected to this input and emit a converted value
+	*			  (materialized outputs are sampled from their intermediate image)
+	*			- is it not connected? continue to step (iii)
+	*		iii. If the parameter is a node param
+	*			- emit a converted value
+	*		iv.  Otherwise
+	*			- check for builtins
+	*			- emit a default value otherwise
+	*	c. Emit the output parameters
+	*/
+	void emitNodeCall(ShaderGen& gen, GraphicsNode* node) {
+		auto nodeFunction = node->functionNameTemplate().fill(node->id());
+
+		// a
+		gen.pasteFunction(nodeFunction);
 
-		generatedShader = std::make_unique<Shader>();
-		generatedShader->add(gen.generate(), GL_COMPUTE_SHADER);
-		generatedShader->link();
+		gen.indent();
+		gen.append(std::format("{}(", nodeFunction));
 
-		render();
-	}
+		// b
+		auto nodeParams = node->parameters();
+		auto fn = gen.getFunction(nodeFunction);
 
-	void render(uint32_t width = 1024, uint32_t height = 1024) {
-		if (!generatedShader) return;
+		size_t i = 0;
+		for (auto&& param : fn.parameterOrder) {
+			auto paramOb = fn.parameters[param];
+			if (paramOb.qualifier == ShaderFunctionParam::out) continue;
+
+			// i
+			auto [inputParamName, sType] = nodeParams[param];
+			bool appendComma = false;
+
+			// ii
+			if (node->hasInput(inputParamName)) {
+				auto con = liveInputTo(node, node->inputIndex(inputParamName));
+				if (con) { // connected
+					auto&& nv = con->source->texture(con->sourceOutput);
+					gen.convertType(
+						nv.type,
+						paramOb.type,
+						connectionValue(*con)
+					);
+					appendComma = true;
+				}
+				else {
+					// iii
+					appendComma = checkParams(gen, node, inputParamName, sType, paramOb.type);
+				}
+			}
+			// iii
+			else {
+				appendComma = checkParams(gen, node, inputParamName, sType, paramOb.type);
+			}
 
-		glUseProgram(generatedShader->id());
-		generatedShader->uniform<2>("bOutputSize", { float(width), float(height) });
+			if (appendComma && i < fn.parameterOrder.size() - 1) {
+				gen.append(", ");
+			}
 
-		// render outputs
-		size_t binding = 0;
-		for (const auto& nodeId : m_nodePath) {
-			auto node = get(nodeId);
-			GraphicsNode* gnode = dynamic_cast<GraphicsNode*>(node);
+			i++;
+		}
 
-			if (gnode->render(width, height, binding)) {
-				binding++;
+		// c
+		if (node->outputCount() > 0) {
+			for (size_t i = 0; i < node->outputCount(); i++) {
+				auto varName = std::format("out_{}_{}", node->id(), i);
+				gen.append(varName);
+				if (i < node->outputCount() - 1) {
+					gen.append(", ");
+				}
 			}
 		}
 
-		setUniforms(binding);
-		
-		glDispatchCompute(width / 16, height / 16, 1);
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		gen.append(");\n");
 	}
 
 	void save(olc::utils::datafile& out) {
@@ -275,54 +1275,236 @@ public:
 
 		// connections
 		size_t i = 0;
-		for (auto& conn : m_connections) {
-			olc::utils::datafile& linkData = out["connections"][std::format("conn_{}", i)];
-			linkData["source"].SetInt(conn.source->id());
-			linkData["destination"].SetInt(conn.destination->id());
-			linkData["sourceOutput"].SetInt(conn.sourceOutput);
-			linkData["destinationInput"].SetInt(conn.destinationInput);
-			i++;
+		for (auto& node : m_nodes) {
+			for (const auto& conn : getNodeOutputConnections(node.get())) {
+				olc::utils::datafile& linkData = out["connections"][std::format("conn_{}", i)];
+				linkData["source"].SetInt(conn.source->id());
+				linkData["destination"].SetInt(conn.destination->id());
+				linkData["sourceOutput"].SetInt(conn.sourceOutput);
+				linkData["destinationInput"].SetInt(conn.destinationInput);
+				i++;
+			}
 		}
 	}
 
-	std::unique_ptr<Shader> generatedShader;
+	std::shared_ptr<Shader> generatedShader;
 
 private:
-	void setUniform(const std::string& name, const NodeValue& nv, size_t index) {
-		auto shader = generatedShader.get();
+	void setUniform(Shader& shader, const std::string& name, const NodeValue& nv, size_t index, GLenum imageFormat = GL_RGBA32F) {
 		switch (nv.type) {
-			case ValueType::scalar: shader->uniform<1>(name, { nv.value[0] }); break;
-			case ValueType::vec2: shader->uniform<2>(name, { nv.value[0], nv.value[1] }); break;
-			case ValueType::vec3: shader->uniform<3>(name, { nv.value[0], nv.value[1], nv.value[2] }); break;
-			case ValueType::vec4: shader->uniform<4>(name, nv.value); break;
+			case ValueType::scalar: shader.uniform<1>(name, { nv.value[0] }); break;
+			case ValueType::vec2: shader.uniform<2>(name, { nv.value[0], nv.value[1] }); break;
+			case ValueType::vec3: shader.uniform<3>(name, { nv.value[0], nv.value[1], nv.value[2] }); break;
+			case ValueType::vec4: shader.uniform<4>(name, nv.value); break;
 			case ValueType::image: {
-				glBindImageTexture(index, GLuint(nv.value[0]), 0, false, 0, GL_READ_ONLY, GL_RGBA32F);
-				shader->uniformInt<1>(name, { int(index) });
+				glBindImageTexture(index, GLuint(nv.value[0]), 0, false, 0, GL_READ_ONLY, imageFormat);
+				shader.uniformInt<1>(name, { int(index) });
 			} break;
 		}
 	}
 
-	void setNodeUniforms(GraphicsNode* node, size_t& binding) {
-		for (auto& [paramName, nv] : node->params()) {
-			auto uniName = std::format("param_{}_{}", node->id(), toCamelCase(paramName));
-			
-			// UNIFORM
-			setUniform(uniName, nv, binding);
+	static std::string paramUniformName(GraphicsNode* node, const std::string& paramName) {
+		return std::format("param_{}_{}", node->id(), toCamelCase(paramName));
+	}
 
-			// BODY
-			if (nv.type == ValueType::image) {
-				binding++;
+	// the pending program replaces the current one, once linked (blocks otherwise)
+	bool swapPendingShader() {
+		std::shared_ptr<Shader> shader;
+		{
+			GpuProfiler::ScopedTimer timer("link");
+			shader = ShaderCache::shared().finish(m_pendingSource, std::move(m_pendingShader));
+		}
+		m_pendingShader.reset();
+		m_pendingSource.clear();
+
+		if (shader) {
+			m_interpreting = false;
+			generatedShader = shader;
+			m_plan = std::move(m_pendingPlan);
+			render();
+		}
+		return shader != nullptr;
+	}
+
+	/*
+	 * Times the candidate workgroup shapes of the current program, one step per frame, once the
+	 * graph went g_TuningDelay frames without edits: each candidate is compiled in the background,
+	 * then dispatched a few times at the size of the last render, between GL_TIME_ELAPSED queries that
+	 * are read in a later frame, when the GPU is done with them. The fastest shape is remembered for the
+	 * program and swapped in.
+	 */
+	void tuneWorkGroupSize() {
+		if (m_tuningIndex >= m_tuning.size() || !generatedShader) return;
+		if (m_tuningIdleFrames++ < g_TuningDelay) return;
+
+		auto& cache = ShaderCache::shared();
+		auto& candidate = m_tuning[m_tuningIndex];
+		if (!candidate.shader) {
+			candidate.shader = cache.find(candidate.source);
+			if (!candidate.shader) {
+				candidate.shader = cache.compile(candidate.source);
+				return;
+			}
+		}
+		else if (!candidate.shader->linked()) {
+			if (!candidate.shader->linkCompleted()) return;
+			candidate.shader = cache.finish(candidate.source, std::move(candidate.shader));
+		}
+
+		if (candidate.shader) {
+			if (candidate.queries[0] == 0) {
+				glGenQueries(GLsizei(g_TuningRuns), candidate.queries.data());
+				for (GLuint query : candidate.queries) {
+					glBeginQuery(GL_TIME_ELAPSED, query);
+					dispatch(*candidate.shader, candidate.plan, m_renderWidth, m_renderHeight, { 0, 0, m_renderWidth, m_renderHeight });
+					glEndQuery(GL_TIME_ELAPSED);
+				}
+				return;
+			}
+
+			// the runs finish in order
+			GLint available = 0;
+			glGetQueryObjectiv(candidate.queries.back(), GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) return;
+
+			for (GLuint query : candidate.queries) {
+				GLuint64 time = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &time);
+				candidate.time = std::min<uint64_t>(candidate.time, time);
 			}
-			
 		}
+
+		if (++m_tuningIndex < m_tuning.size()) return;
+
+		// done, keep the fastest
+		auto best = std::min_element(m_tuning.begin(), m_tuning.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+		if (best->time != UINT64_MAX) {
+			storeTunedWorkGroupSize(m_tuningKey, best->plan.workGroupSize);
+
+			m_interpreting = false;
+			generatedShader = best->shader;
+			m_plan = std::move(best->plan);
+			render(m_renderWidth, m_renderHeight);
+		}
+		resetTuning();
+	}
+
+	void resetTuning() {
+		for (auto& candidate : m_tuning) {
+			if (candidate.queries[0] != 0) glDeleteQueries(GLsizei(g_TuningRuns), candidate.queries.data());
+		}
+		m_tuning.clear();
+		m_tuningIndex = 0;
+		m_tuningIdleFrames = 0;
+	}
+
+	// image params are bound through the render plan
+	void setUniforms(Shader& shader) {
+		for (size_t i = m_livePath.size(); i-- > 0;) {
+			auto node = static_cast<GraphicsNode*>(get(m_livePath[i]));
+			for (auto& [paramName, nv] : node->params()) {
+				if (nv.type == ValueType::image) continue;
+				setUniform(shader, paramUniformName(node, paramName), nv, 0);
+			}
+		}
+	}
+
+	// The input a multipass node samples through $TREE
+	const Connection* multipassSource(GraphicsNode* node) {
+		if (!node->multiPassNode()) return nullptr;
+
+		const Connection* source = nullptr;
+		for (const auto& conn : liveInputs(node)) {
+			if (!source || conn.destinationInput < source->destinationInput) {
+				source = &conn;
+			}
+		}
+		return source;
+	}
+
+	bool isMaterialized(const Connection& conn) const {
+		return m_materialized.contains({ conn.source->id(), conn.sourceOutput });
 	}
 
-	void setUniforms(size_t startBinding) {
-		size_t binding = startBinding;
-		for (size_t i = m_nodePath.size(); i-- > 0;) {
-			auto node = static_cast<GraphicsNode*>(get(m_nodePath[i]));
-			setNodeUniforms(node, binding);
+	// GLSL expression for the value flowing through a connection, in the type of the source output
+	std::string connectionValue(const Connection& conn) {
+		if (!isMaterialized(conn)) {
+			return std::format("out_{}_{}", conn.source->id(), conn.sourceOutput);
 		}
+
+		static const char* swizzle[] = { "", ".r", ".rg", ".rgb", "", "" };
+		auto type = conn.source->texture(conn.sourceOutput).type;
+		return std::format("mat_{}_{}(cUV){}", conn.source->id(), conn.sourceOutput, swizzle[size_t(type)]);
+	}
+
+	// Nodes needed to evaluate the roots, in execution order.
+	// Materialized outputs are not followed, they come from another pass.
+	std::vector<Node*> collectPassNodes(const std::vector<Node*>& roots) {
+		std::unordered_set<Node*> needed(roots.begin(), roots.end());
+		std::vector<Node*> stack = roots;
+
+		while (!stack.empty()) {
+			Node* node = stack.back(); stack.pop_back();
+
+			for (const auto& conn : liveInputs(node)) {
+				if (isMaterialized(conn)) continue;
+				if (needed.insert(conn.source).second) {
+					stack.push_back(conn.source);
+				}
+			}
+		}
+
+		std::vector<Node*> nodes;
+		for (const auto& nodeId : m_livePath) {
+			auto node = get(nodeId);
+			if (needed.contains(node)) {
+				nodes.push_back(node);
+			}
+		}
+		return nodes;
+	}
+
+	static float nodeCost(Node* node) {
+		auto gnode = static_cast<GraphicsNode*>(node);
+		return gnode->aluCost() + gnode->sampleCount() * g_FetchCost;
+	}
+
+	// cost of evaluating a node with everything that would be fused into it
+	float subtreeCost(Node* node) {
+		float cost = 0.0f;
+		for (Node* n : collectPassNodes({ node })) {
+			cost += nodeCost(n);
+		}
+		return cost;
+	}
+
+	float passCost(const RenderPass& pass) {
+		float cost = g_PassCost + float(pass.outputs.size()) * g_StoreCost;
+
+		std::set<std::pair<size_t, size_t>> reads;
+		for (Node* node : pass.nodes) {
+			cost += nodeCost(node);
+
+			auto source = multipassSource(static_cast<GraphicsNode*>(node)); // counted in sampleCount
+			for (const auto& conn : liveInputs(node)) {
+				if (&conn != source && isMaterialized(conn)) {
+					reads.insert({ conn.source->id(), conn.sourceOutput });
+				}
+			}
+		}
+		return cost + float(reads.size()) * g_FetchCost;
+	}
+
+	Texture& intermediateImage(size_t index, uint32_t width, uint32_t height) {
+		if (index >= m_intermediateImages.size()) {
+			m_intermediateImages.resize(index + 1);
+		}
+
+		auto& image = m_intermediateImages[index];
+		if (!image || image->size()[0] != width || image->size()[1] != height) {
+			image = TexturePool::shared().acquire({ width, height, 1 }, GL_RGBA32F);
+		}
+		return *image;
 	}
 
 	bool checkParams(
@@ -353,11 +1535,10 @@ private:
 
 				std::string varName = "cUV";
 				if (uvsSpecialType != SpecialType::none) {
-					auto conns = getConnectionsToInput(node, node->inputIndex(uvsName));
-					if (!conns.empty()) { // connected
-						auto&& con = conns.front();
-						auto&& nv = con.source->texture(con.sourceOutput);
-						varName = std::format("out_{}_{}", con.source->id(), con.sourceOutput);
+					auto con = liveInputTo(node, node->inputIndex(uvsName));
+					if (con) { // connected
+						auto&& nv = con->source->texture(con->sourceOutput);
+						varName = connectionValue(*con);
 						uvsType = nv.type;
 					}
 				}
@@ -370,6 +1551,11 @@ private:
 				else {
 					gen.append("cUV)");
 				}
+
+				// single channel images load as (r, 0, 0, 1)
+				if (storageFormatInfo(storageFormatOf(node)).channels == 1) {
+					gen.append(".rrra");
+				}
 			}
 			else {
 				std::string varName = std::format("param_{}_{}", node->id(), toCamelCase(inputParamName));
@@ -399,14 +1585,13 @@ private:
 				}
 
 				if (uvsSpecialType != SpecialType::none) {
-					auto conns = getConnectionsToInput(node, node->inputIndex(uvsName));
-					if (!conns.empty()) { // connected
-						auto&& con = conns.front();
-						auto&& nv = con.source->texture(con.sourceOutput);
+					auto con = liveInputTo(node, node->inputIndex(uvsName));
+					if (con) { // connected
+						auto&& nv = con->source->texture(con->sourceOutput);
 						gen.convertType(
 							nv.type,
 							ValueType::vec2,
-							std::format("out_{}_{}", con.source->id(), con.sourceOutput)
+							connectionValue(*con)
 						);
 					}
 					else {
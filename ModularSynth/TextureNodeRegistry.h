@@ -344,7 +344,80 @@ static Control* gui_ThresholdNode(VisualNode* node) {
 	return pnl;
 }
 
+// channel count and precision of a node image, rows of the table are the channel options
+static Control* gui_StorageFormat(StorageFormat* format, const std::function<void()>& onChange) {
+	static const StorageFormat formats[2][3] = {
+		{ StorageFormat::rgba8, StorageFormat::rgba16f, StorageFormat::rgba32f },
+		{ StorageFormat::r8, StorageFormat::r16f, StorageFormat::r32f }
+	};
+
+	int channels = 0, precision = 0;
+	for (int c = 0; c < 2; c++) {
+		for (int p = 0; p < 3; p++) {
+			if (formats[c][p] == *format) {
+				channels = c;
+				precision = p;
+			}
+		}
+	}
+
+	Panel* pnl = new Panel();
+	pnl->drawBackground(false);
+	pnl->bounds = { 0, 0, 0, 60 };
+	pnl->setLayout(new ColumnLayout());
+
+	RadioSelector* chSel = new RadioSelector();
+	chSel->bounds = { 0, 0, 0, 25 };
+	chSel->addOption(0, "RGBA");
+	chSel->addOption(1, "R");
+	chSel->select(channels);
+
+	RadioSelector* prSel = new RadioSelector();
+	prSel->bounds = { 0, 0, 0, 25 };
+	prSel->addOption(0, "8");
+	prSel->addOption(1, "16F");
+	prSel->addOption(2, "32F");
+	prSel->select(precision);
+
+	chSel->onSelect = [=](int index) {
+		*format = formats[index][prSel->selected()];
+		onChange();
+	};
+	prSel->onSelect = [=](int index) {
+		*format = formats[chSel->selected()][index];
+		onChange();
+	};
+
+	pnl->addChild(gui_Labelled("Channels", chSel));
+	pnl->addChild(gui_Labelled("Precision", prSel));
+
+	return pnl;
+}
+
+static void loadImage(ImageNode* nd, const std::string& path) {
+	int w, h, comp;
+	auto data = stbi_loadf(path.c_str(), &w, &h, &comp, STBI_rgb_alpha);
+	if (!data) return;
+
+	if (nd->handle) {
+		delete nd->handle;
+	}
+
+	// single channel formats keep the red channel
+	nd->handle = new Texture({ uint32_t(w), uint32_t(h), 1 }, storageFormatInfo(nd->format).internalFormat);
+	nd->handle->loadFromMemory(data, GL_RGBA, GL_FLOAT);
+	stbi_image_free(data);
+
+	nd->path = path;
+	nd->setParam("Image", float(nd->handle->id()));
+}
+
 static Control* gui_ImageNode(VisualNode* node) {
+	Panel* pnl = new Panel();
+	pnl->drawBackground(false);
+	pnl->bounds = { 0, 0, 0, 90 };
+	pnl->setLayout(new ColumnLayout());
+
 	Button* btn = new Button();
 	btn->text = "Load Texture";
 
@@ -359,20 +432,22 @@ static Control* gui_ImageNode(VisualNode* node) {
 			pfd::opt::none
 		);
 		if (!fp.result().empty()) {
-			if (nd->handle) {
-				delete nd->handle;
-			}
+			loadImage(nd, fp.result().front());
+		}
+	};
+	pnl->addChild(btn);
 
-			int w, h, comp;
-			auto data = stbi_loadf(fp.result().front().c_str(), &w, &h, &comp, STBI_rgb_alpha);
+	pnl->addChild(gui_StorageFormat(&nd->format, [=]() {
+		if (!nd->path.empty()) loadImage(nd, nd->path);
+		nd->markChanged();
+	}));
 
-			nd->handle = new Texture({ uint32_t(w), uint32_t(h) }, GL_RGBA32F);
-			nd->handle->loadFromMemory(data, GL_RGBA, GL_FLOAT);
+	return pnl;
+}
 
-			nd->setParam("Image", float(nd->handle->id()));
-		}
-	};
-	return btn;
+static Control* gui_OutputNode(VisualNode* node) {
+	OutputNode* nd = (OutputNode*)node->node();
+	return gui_StorageFormat(&nd->format, [=]() { nd->markChanged(); });
 }
 
 static Control* gui_UVNode(VisualNode* node) {
@@ -518,7 +593,7 @@ static NodeContructor nodeTypes[] = {
 	{ "UVS", "UV", NodeCtor(UVNode, generatorNodeColor), gui_UVNode },
 	{ "RGR", "Radial Gradient", NodeCtor(RadialGradientNode, generatorNodeColor), nullptr },
 	{ "NRM", "Normal Map", NodeCtor(NormalMapNode, multisampleNodeColor), gui_NormalMapNode },
-	{ "OUT", "Output", NodeCtor(OutputNode, resultNodeColor), nullptr },
+	{ "OUT", "Output", NodeCtor(OutputNode, resultNodeColor), gui_OutputNode },
 
 	{ "SCIRCLE", "Circle", NodeCtor(CircleShapeNode, generatorNodeColor), gui_CircleShapeNode },
 	{ "SBOX", "Box", NodeCtor(BoxShapeNode, generatorNodeColor), gui_BoxShapeNode },
@@ -2,6 +2,7 @@
 
 #include "GraphicsNode.h"
 #include "Texture.h"
+#include "TexturePool.h"
 
 #include "escapi.h"
 #include <Windows.h>
@@ -32,6 +33,8 @@ public:
 
 class SimpleGradientNode : public GraphicsNode {
 public:
+	float aluCost() override { return 4.0f; }
+
 	std::string library() {
 		return R"(void gen_simple_gradient(in vec2 uv, float angle, out float res) {
 	float c = cos(angle);
@@ -60,6 +63,8 @@ public:
 
 class MixNode : public GraphicsNode {
 public:
+	float aluCost() override { return 4.0f; }
+
 	std::string library() {
 		return R"(void opr_mix_blend(float fac, vec4 ca, vec4 cb, out vec4 outColor) {
 	outColor = mix(ca, cb, clamp(fac, 0.0, 1.0));
@@ -121,6 +126,8 @@ void opr_mix(float fac, float op, vec4 ca, vec4 cb, out vec4 outColor) {
 
 class NoiseNode : public GraphicsNode {
 public:
+	float aluCost() override { return 150.0f; }
+
 	std::string functionName() { return "gen_noise"; }
 
 	std::string library() {
@@ -213,6 +220,8 @@ void gen_noise(in vec2 uv, float scale, float patternX, float patternY, out floa
 
 class ThresholdNode : public GraphicsNode {
 public:
+	float aluCost() override { return 3.0f; }
+
 	std::string library() {
 		return R"(void opr_threshold(in vec4 color, float threshold, float feather, out float outValue) {
 	float fac = feather / 2.0;
@@ -247,6 +256,8 @@ public:
 
 class ImageNode : public GraphicsNode {
 public:
+	float sampleCount() override { return 1.0f; }
+
 	std::string library() {
 		return R"(void gen_image(in vec4 img, out vec4 outColor) {
 	outColor = img;
@@ -268,12 +279,26 @@ public:
 		addOutput("Output", ValueType::vec4);
 	}
 
-	Texture* handle;
+	void saveTo(olc::utils::datafile& df) override {
+		GraphicsNode::saveTo(df);
+		df["storageFormat"].SetInt(int(format));
+	}
+
+	void loadFrom(olc::utils::datafile& df) override {
+		GraphicsNode::loadFrom(df);
+		format = StorageFormat(std::clamp(df["storageFormat"].GetInt(), 0, int(StorageFormat::r8)));
+	}
+
+	Texture* handle{ nullptr };
+	StorageFormat format{ StorageFormat::rgba32f }; // of handle, single channel images keep the red channel
+	std::string path; // the image is reloaded when the format changes
 
 };
 
 class UVNode : public GraphicsNode {
 public:
+	float aluCost() override { return 12.0f; }
+
 	/** TODO: Need a node for this part:
 		vec2 s = 1.0 / vec2(imageSize(uInDeform));
         
@@ -379,6 +404,8 @@ void out_uv(
 
 class RadialGradientNode : public GraphicsNode {
 public:
+	float aluCost() override { return 3.0f; }
+
 	std::string library() {
 		return R"(void gen_radial_gradient(in vec2 uv, out float res) {
 	vec2 center = clamp(uv, 0.0, 1.0) * 2.0 - 1.0;
@@ -402,12 +429,17 @@ public:
 
 class NormalMapNode : public GraphicsNode {
 public:
+	float aluCost() override { return 10.0f; }
+	float sampleCount() override { return 3.0f; }
+
 	bool multiPassNode() {
 		return true;
 	}
 
+	uint32_t kernelRadius() override { return 1; }
+
 	std::string library() {
-		return R"(void gen_normal_map(in vec2 uv, float scale, out vec3 res) {
+		return R"(void gen_normal_map_$NODE(in vec2 uv, float scale, out vec3 res) {
 	vec2 step = 1.0 / bOutputSize;
 
 	float height = rgb_to_float($TREE(uv).rgb);
@@ -420,7 +452,8 @@ public:
 })";
 	}
 
-	std::string functionName() { return "gen_normal_map"; }
+	// one function per node, each samples its own $TREE
+	std::string functionName() { return "gen_normal_map_$NODE"; }
 
 	GraphicsNodeParams parameters() {
 		return {
@@ -442,7 +475,7 @@ public:
 	std::string library() {
 		return R"(
 void emit_out_$NODE(in vec2 uv, vec4 color) {
-	imageStore(bOutput$NODE, ivec2(uv * vec2(imageSize(bOutput$NODE))), color);
+	imageStore(bOutput$NODE, TileCoords(uv), color);
 })";
 	}
 
@@ -460,25 +493,34 @@ void emit_out_$NODE(in vec2 uv, vec4 color) {
 	}
 
 	bool render(uint32_t width, uint32_t height, size_t binding = 0) override {
-		if (!texture) {
-			texture = std::unique_ptr<Texture>(new Texture({ width, height }, GL_RGBA32F));
-		}
-		else {
-			if (texture->size()[0] != width || texture->size()[1] != height) {
-				texture.reset(nullptr);
-				texture = std::unique_ptr<Texture>(new Texture({ width, height }, GL_RGBA32F));
-			}
+		const GLenum internalFormat = storageFormatInfo(format).internalFormat;
+		if (!texture || texture->size()[0] != width || texture->size()[1] != height || texture->internalFormat() != internalFormat) {
+			// the previous one goes back to the pool, resizing back and forth doesn't reallocate
+			texture = TexturePool::shared().acquire({ width, height, 1 }, internalFormat);
 		}
 
-		glBindImageTexture(binding, texture->id(), 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(binding, texture->id(), 0, false, 0, GL_WRITE_ONLY, internalFormat);
 		return true;
 	}
 
-	std::unique_ptr<Texture> texture;
+	void saveTo(olc::utils::datafile& df) override {
+		GraphicsNode::saveTo(df);
+		df["storageFormat"].SetInt(int(format));
+	}
+
+	void loadFrom(olc::utils::datafile& df) override {
+		GraphicsNode::loadFrom(df);
+		format = StorageFormat(std::clamp(df["storageFormat"].GetInt(), 0, int(StorageFormat::r8)));
+	}
+
+	std::shared_ptr<Texture> texture;
+	StorageFormat format{ StorageFormat::rgba32f }; // part of the generated code, see TextureNodeGraph::update
 };
 
 class CircleShapeNode : public GraphicsNode {
 public:
+	float aluCost() override { return 3.0f; }
+
 	std::string library() {
 		return R"(
 void gen_shape_circle(in vec2 uv, float r, out float res) {
@@ -506,6 +548,8 @@ void gen_shape_circle(in vec2 uv, float r, out float res) {
 
 class BoxShapeNode : public GraphicsNode {
 public:
+	float aluCost() override { return 8.0f; }
+
 	std::string library() {
 		return R"(
 void gen_shape_box(in vec2 uv, vec2 b, in vec4 r, out float res) {
@@ -542,6 +586,8 @@ void gen_shape_box(in vec2 uv, vec2 b, in vec4 r, out float res) {
 
 class WebCamNode : public GraphicsNode {
 public:
+	float sampleCount() override { return 1.0f; }
+
 	std::string library() {
 		return R"(void gen_sample_webcam(in vec4 img, out vec4 outColor) {
 	outColor = img;
@@ -0,0 +1,120 @@
+#include "TexturePool.h"
+
+#include <algorithm>
+
+TexturePool& TexturePool::shared() {
+	static TexturePool pool{};
+	return pool;
+}
+
+TexturePool::~TexturePool() {
+	*m_alive = false;
+	clear();
+}
+
+size_t TexturePool::KeyHash::operator()(const Key& key) const {
+	size_t h = std::hash<uint32_t>{}(key.size[0]);
+	for (uint32_t v : { key.size[1], key.size[2], uint32_t(key.internalFormat), key.levels }) {
+		h ^= std::hash<uint32_t>{}(v) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	}
+	return h;
+}
+
+static size_t texelSize(GLenum internalFormat) {
+	switch (internalFormat) {
+		case GL_R8: return 1;
+		case GL_R16F: case GL_RG8: return 2;
+		case GL_RGB8: return 3;
+		case GL_R32F: case GL_RG16F: case GL_RGBA8: case GL_SRGB8_ALPHA8: return 4;
+		case GL_RGB16F: return 6;
+		case GL_RG32F: case GL_RGBA16F: return 8;
+		case GL_RGB32F: return 12;
+		case GL_RGBA32F: return 16;
+		default: return 4;
+	}
+}
+
+size_t TexturePool::byteSize(const Key& key) {
+	size_t bytes = 0;
+	std::array<size_t, 3> size = { key.size[0], key.size[1], key.size[2] };
+	for (uint32_t level = 0; level < key.levels; level++) {
+		bytes += size[0] * size[1] * size[2] * texelSize(key.internalFormat);
+		for (auto& s : size) s = std::max<size_t>(s / 2, 1);
+	}
+	return bytes;
+}
+
+std::shared_ptr<Texture> TexturePool::acquire(const std::array<uint32_t, 3>& size, GLenum internalFormat, uint32_t levels) {
+	const Key key{ size, internalFormat, levels };
+
+	std::unique_ptr<Texture> texture;
+	if (auto found = m_index.find(key); found != m_index.end()) {
+		auto it = found->second;
+		texture = std::move(it->texture);
+		erase(it);
+		m_stats.hits++;
+	}
+	else {
+		texture = std::make_unique<Texture>(size, internalFormat, 2, GL_TEXTURE_2D, levels);
+		m_stats.misses++;
+	}
+
+	m_stats.liveBytes += byteSize(key);
+	m_stats.liveTextures++;
+	trim();
+
+	return std::shared_ptr<Texture>(texture.release(), [this, alive = m_alive](Texture* texture) {
+		if (*alive) release(texture);
+		else delete texture;
+	});
+}
+
+void TexturePool::release(Texture* texture) {
+	const Key key{ texture->size(), texture->internalFormat(), texture->levels() };
+	const size_t bytes = byteSize(key);
+
+	m_stats.liveBytes -= bytes;
+	m_stats.liveTextures--;
+
+	m_idle.push_front({ key, std::unique_ptr<Texture>(texture), bytes });
+	m_index.insert({ key, m_idle.begin() });
+	m_stats.pooledBytes += bytes;
+	m_stats.pooledTextures++;
+
+	trim();
+}
+
+void TexturePool::setByteBudget(size_t bytes) {
+	m_byteBudget = bytes;
+	trim();
+}
+
+void TexturePool::clear() {
+	m_idle.clear();
+	m_index.clear();
+	m_stats.pooledBytes = 0;
+	m_stats.pooledTextures = 0;
+}
+
+void TexturePool::erase(std::list<Entry>::iterator it) {
+	auto [begin, end] = m_index.equal_range(it->key);
+	for (auto i = begin; i != end; ++i) {
+		if (i->second == it) {
+			m_index.erase(i);
+			break;
+		}
+	}
+
+	m_stats.pooledBytes -= it->bytes;
+	m_stats.pooledTextures--;
+	m_idle.erase(it);
+}
+
+// Deletes the least recently released idle textures until live + idle fits the budget.
+// Live textures are never touched, the pool can stay over budget while they are in use.
+void TexturePool::trim() {
+	while (m_stats.liveBytes + m_stats.pooledBytes > m_byteBudget && !m_idle.empty()) {
+		erase(std::prev(m_idle.end()));
+		m_stats.evictions++;
+	}
+}
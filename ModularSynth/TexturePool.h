@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <list>
+#include <memory>
+#include <array>
+#include <unordered_map>
+
+/*
+ * Recycles textures by shape: (size, internal format, mip levels).
+ * acquire() hands out an idle texture of that shape if there is one, and the texture comes back
+ * to the pool when its last owner lets go of it instead of being deleted. Idle textures are
+ * evicted least recently used first while the pool is over its byte budget (live + idle).
+ * The contents of a recycled texture are undefined, meant for render targets.
+ */
+class TexturePool {
+public:
+	struct Key {
+		std::array<uint32_t, 3> size{ 1, 1, 1 };
+		GLenum internalFormat{ GL_RGBA8 };
+		uint32_t levels{ 1 };
+
+		bool operator==(const Key&) const = default;
+	};
+
+	struct Stats {
+		size_t hits{ 0 }, misses{ 0 }, evictions{ 0 };
+		size_t liveBytes{ 0 }, pooledBytes{ 0 };
+		size_t liveTextures{ 0 }, pooledTextures{ 0 };
+	};
+
+	explicit TexturePool(size_t byteBudget = 512 * 1024 * 1024) : m_byteBudget(byteBudget) {}
+	~TexturePool();
+
+	// 2D texture of this shape, back to the pool once released
+	std::shared_ptr<Texture> acquire(const std::array<uint32_t, 3>& size, GLenum internalFormat, uint32_t levels = 1);
+
+	void setByteBudget(size_t bytes);
+	size_t byteBudget() const { return m_byteBudget; }
+
+	const Stats& stats() const { return m_stats; }
+
+	// deletes the idle textures
+	void clear();
+
+	static size_t byteSize(const Key& key);
+
+	static TexturePool& shared();
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	struct Entry {
+		Key key;
+		std::unique_ptr<Texture> texture;
+		size_t bytes;
+	};
+
+	std::list<Entry> m_idle; // most recently released first
+	std::unordered_multimap<Key, std::list<Entry>::iterator, KeyHash> m_index;
+
+	size_t m_byteBudget;
+	Stats m_stats{};
+
+	// cleared by the destructor, textures released after it are deleted
+	std::shared_ptr<bool> m_alive{ std::make_shared<bool>(true) };
+
+	void release(Texture* texture);
+	void erase(std::list<Entry>::iterator it);
+	void trim();
+};
@@ -0,0 +1,150 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+static thread_local const ThreadPool* t_ownerPool = nullptr;
+static thread_local size_t t_queueIndex = 0;
+
+ThreadPool::ThreadPool(size_t threadCount) {
+	threadCount = std::max<size_t>(threadCount, 1);
+
+	for (size_t i = 0; i < threadCount + 1; i++) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+
+	for (size_t i = 0; i < threadCount; i++) {
+		m_threads.emplace_back([this, i]() { workerLoop(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_running = false;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool{};
+	return pool;
+}
+
+size_t ThreadPool::currentQueue() const {
+	return t_ownerPool == this ? t_queueIndex : externalQueue();
+}
+
+void ThreadPool::submit(Task task, TaskGroup* group) {
+	Queue& queue = *m_queues[currentQueue()];
+
+	m_pending++;
+	if (group) {
+		group->m_pending++;
+		group->m_queued++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back({ std::move(task), group });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued++;
+	}
+	m_wake.notify_one();
+
+	// a thread waiting on the group can run it
+	if (group) m_done.notify_all();
+}
+
+void ThreadPool::wait() {
+	const size_t index = currentQueue();
+	while (m_pending > 0) {
+		if (runOne(index)) continue;
+
+		// nothing to steal, the remaining tasks are running on other threads
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_done.wait(lock, [this]() { return m_pending == 0 || m_queued > 0; });
+	}
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	const size_t index = currentQueue();
+	while (group.m_pending > 0) {
+		if (runOne(index, &group)) continue;
+
+		// the rest of the group is running on other threads
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_done.wait(lock, [&group]() { return group.m_pending == 0 || group.m_queued > 0; });
+	}
+}
+
+void ThreadPool::workerLoop(size_t index) {
+	t_ownerPool = this;
+	t_queueIndex = index;
+
+	while (true) {
+		if (runOne(index)) continue;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() { return !m_running || m_queued > 0; });
+		if (!m_running && m_queued == 0) break;
+	}
+}
+
+bool ThreadPool::runOne(size_t index, const TaskGroup* group) {
+	Entry entry;
+	if (!pop(index, entry, group) && !steal(index, entry, group)) {
+		return false;
+	}
+
+	m_queued--;
+	if (entry.group) entry.group->m_queued--;
+	entry.task();
+
+	// the group may be gone as soon as its count reaches zero
+	const bool groupDone = entry.group && --entry.group->m_pending == 0;
+	const bool allDone = --m_pending == 0;
+	if (groupDone || allDone) {
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_done.notify_all();
+	}
+	return true;
+}
+
+bool ThreadPool::pop(size_t index, Entry& entry, const TaskGroup* group) {
+	Queue& queue = *m_queues[index];
+
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+		if (group && it->group != group) continue;
+
+		entry = std::move(*it);
+		queue.tasks.erase(std::next(it).base());
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::steal(size_t thief, Entry& entry, const TaskGroup* group) {
+	const size_t count = m_queues.size();
+	for (size_t i = 1; i < count; i++) {
+		Queue& queue = *m_queues[(thief + i) % count];
+
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (auto it = queue.tasks.begin(); it != queue.tasks.end(); ++it) {
+			if (group && it->group != group) continue;
+
+			entry = std::move(*it);
+			queue.tasks.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
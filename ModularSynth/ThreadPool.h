@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/*
+ * WORK-STEALING THREAD POOL
+ * ====================================================
+ * Every worker owns a deque. Tasks submitted from a worker go to the back of its own deque
+ * and are popped from the back (LIFO, cache friendly). Idle workers steal from the front of
+ * the other deques (FIFO, oldest work first). Tasks submitted from outside the pool go to an
+ * extra shared deque that everyone steals from.
+ */
+class ThreadPool {
+public:
+	using Task = std::function<void()>;
+
+	// Tasks submitted with the same group are waited for together, apart from the rest of the pool's work
+	class TaskGroup {
+		friend class ThreadPool;
+	public:
+		bool done() const { return m_pending == 0; }
+
+	private:
+		std::atomic<size_t> m_pending{ 0 }, m_queued{ 0 };
+	};
+
+	explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	void submit(Task task, TaskGroup* group = nullptr);
+
+	// Blocks until every submitted task has finished, running tasks on the calling thread meanwhile.
+	void wait();
+
+	// Blocks until the tasks of the group have finished. Only tasks of that group run on the calling thread meanwhile.
+	void wait(TaskGroup& group);
+
+	size_t threadCount() const { return m_threads.size(); }
+
+	// pool shared by the whole application, created on first use
+	static ThreadPool& shared();
+
+private:
+	struct Entry {
+		Task task;
+		TaskGroup* group{ nullptr };
+	};
+
+	struct Queue {
+		std::deque<Entry> tasks;
+		std::mutex mutex;
+	};
+
+	std::vector<std::unique_ptr<Queue>> m_queues; // one per worker + the external queue
+	std::vector<std::thread> m_threads;
+
+	std::atomic<size_t> m_queued{ 0 }, m_pending{ 0 };
+	std::atomic<bool> m_running{ true };
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake, m_done;
+
+	void workerLoop(size_t index);
+	// group filters the tasks that may be picked, nullptr takes any
+	bool runOne(size_t index, const TaskGroup* group = nullptr);
+	bool pop(size_t index, Entry& entry, const TaskGroup* group);
+	bool steal(size_t thief, Entry& entry, const TaskGroup* group);
+
+	size_t externalQueue() const { return m_queues.size() - 1; }
+	size_t currentQueue() const;
+};
@@ -233,6 +233,10 @@ void Window::swapBuffers() {
 	SwapBuffers(m_dc);
 }
 
+void Window::close() {
+	PostMessage(m_handle, WM_CLOSE, 0, 0);
+}
+
 const String& Window::title() const {
 	String title{};
 	title.resize(256);
@@ -57,6 +57,9 @@ public:
 
 	void swapBuffers();
 
+	// pollEvents returns false once the close message is processed
+	void close();
+
 	const String& title() const;
 	void title(const String& title);
 
@@ -1,4 +1,5 @@
 #define SHOW_FPS 1
+#define SHOW_GPU_PROFILER 0
 #include "Application.h"
 #include "GUISystem.h"
 
@@ -19,16 +20,24 @@
 #include "TextureNodeGraph.hpp"
 
 #include "ShaderGen.h"
+#include "ImageExporter.h"
+#include "GpuProfiler.h"
+#include "Bench.h"
 
 #include "Icons.hpp"
 
 #include <format>
 #include <sstream>
 #include <array>
+#include <unordered_map>
 #include <string_view>
+#include <filesystem>
 
 #include <iostream>
 
+constexpr uint32_t exportSize = 4096;
+constexpr uint32_t exportTileSize = 1024;
+
 struct MenuItem {
 	std::string text;
 	size_t icon;
@@ -79,6 +88,7 @@ public:
 		MenuItem menu[] = {
 			{ "Open", icoFolderOpen, [=]() { menu_OpenGraph(); } },
 			{ "Save", icoSave, [=]() { menu_SaveGraph(); } },
+			{ "Export", icoExport, [=]() { menu_Export(); } },
 		};
 
 		for (const auto& item : menu) {
@@ -90,6 +100,13 @@ public:
 			//gui->addControl(menuButton);
 			pnlMenu->addChild(menuButton);
 		}
+
+		// why the last connection was refused, see onConnectionRefused
+		lblStatus = new Label();
+		lblStatus->text = "";
+		lblStatus->fontSize = 15.0f;
+		lblStatus->bounds = topBar.cutLeft(480).toRect();
+		pnlMenu->addChild(lblStatus);
 		//
 
 		ned = gui->create<NodeEditor>(new TextureNodeGraph());
@@ -112,9 +129,8 @@ public:
 
 			OutputNode* out = dynamic_cast<OutputNode*>(node->node());
 			if (out) {
-				if (!out->texture) return;
-
-				previewControl->setTexture(out->texture.get());
+				previewNodeId = out->id();
+				updatePreview();
 			}
 		};
 
@@ -122,6 +138,15 @@ public:
 			graph->render();
 		};
 
+		ned->onConnectionRefused = [=](ConnectionResult result) {
+			switch (result) {
+				default: break;
+				case ConnectionResult::inputInUse: lblStatus->text = "Connection refused: the input is already connected."; break;
+				case ConnectionResult::cycle: lblStatus->text = "Connection refused: it would create a loop."; break;
+			}
+			statusTime = statusDuration;
+		};
+
 		// build the Node list UI
 		for (NodeContructor ctor : nodeTypes) {
 			if (!ctor.onCreate) break;
@@ -151,6 +176,16 @@ public:
 		pnlPreview->addChild(previewControl);
 		//
 
+#if SHOW_GPU_PROFILER
+		GpuProfiler::shared().setEnabled(true);
+
+		pnlProfiler = new Panel();
+		pnlProfiler->title = "GPU Profiler";
+		pnlProfiler->bounds = { float(app.window().size().first) - 268, 62, 256, 320 };
+		pnlProfiler->setLayout(new ColumnLayout());
+		gui->root()->addChild(pnlProfiler);
+#endif
+
 		/*int wgCount[3], wgSize[3];
 		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &wgCount[0]);
 		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &wgCount[1]);
@@ -164,7 +199,16 @@ public:
 
 		std::cout << "Work group size: " << wgSize[0] << ", " << wgSize[1] << ", " << wgSize[2] << '\n';*/
 
-		if(const auto& args = app.args(); args.size() > 1) {
+		const auto& args = app.args();
+		if (std::find(args.begin(), args.end(), "--bench") != args.end()) {
+			// micro-benchmarks instead of the editor, see Bench.h
+			benchNodeGraph();
+			benchLibraryScan();
+			benchEditLatency();
+			benchDispatch();
+			app.window().close();
+		}
+		else if(args.size() > 1) {
 
 			if(!openNodeGraph(args[1])) {
 				auto msg = std::format("Failed to open file '{}' !", args[1]);
@@ -185,10 +229,57 @@ public:
 		glClearColor(bgColor[0], bgColor[1], bgColor[2], 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
+		GpuProfiler::shared().beginFrame();
+
+		if (statusTime > 0.0f) {
+			statusTime -= dt;
+			if (statusTime <= 0.0f) lblStatus->text = "";
+		}
+
+		graph->update();
+		updatePreview();
+		if (exporter) exporter->poll();
+
+#if SHOW_GPU_PROFILER
+		updateProfiler();
+#endif
+
 		gui->onDraw(width, height, dt);
 	}
 
+	// Output nodes get a new texture when their size or format changes (exports, format edits),
+	// the preview follows and holds it so the pool can't recycle it while it's shown
+	void updatePreview() {
+		auto out = dynamic_cast<OutputNode*>(graph->get(previewNodeId));
+		previewTexture = out ? out->texture : nullptr;
+		previewControl->setTexture(previewTexture.get());
+	}
+
+	// one line per scope of the last measured frame
+	void updateProfiler() {
+		const auto& stats = GpuProfiler::shared().lastFrame();
+		while (profilerLines.size() < stats.scopes.size() + 1) {
+			Label* line = new Label();
+			line->fontSize = 13.0f;
+			line->bounds = { 0, 0, 0, 18 };
+			pnlProfiler->addChild(line);
+			profilerLines.push_back(line);
+		}
+
+		profilerLines[0]->text = std::format("GPU {:.2f} ms, CPU {:.2f} ms", stats.gpuMs, stats.cpuMs);
+		for (size_t i = 1; i < profilerLines.size(); i++) {
+			if (i > stats.scopes.size()) {
+				profilerLines[i]->text = "";
+				continue;
+			}
+
+			const auto& scope = stats.scopes[i - 1];
+			profilerLines[i]->text = std::format("{}{}: {:.2f} / {:.2f} ms", std::string(scope.depth * 2, ' '), scope.name, scope.gpuMs, scope.cpuMs);
+		}
+	}
+
 	void onExit() {
+		delete exporter;
 		delete gui;
 	}
 
@@ -228,18 +319,99 @@ public:
 		}
 	}
 
+	// every Output node to its own file, rendered in tiles and written in the background (see ImageExporter)
+	void menu_Export() {
+		auto fp = pfd::save_file(
+			"Export Outputs",
+			pfd::path::home(),
+			{ "PNG Files", "*.png", "OpenEXR Files", "*.exr" },
+			pfd::opt::none
+		);
+		if (fp.result().empty()) return;
+
+		// the readback buffers are only allocated once something is exported
+		if (!exporter) exporter = new ImageExporter();
+
+		// final renders use the generated program with the params baked in, the preview setup is restored after
+		const auto backend = graph->backend();
+		const auto mode = graph->shaderMode();
+		graph->setPipeline(TextureNodeGraph::Backend::fused, TextureNodeGraph::ShaderMode::baked);
+
+		// the interpreter or an older program would still be current
+		if (!graph->finishCompile() || graph->interpreting()) {
+			graph->setPipeline(backend, mode);
+			pfd::message message("Error!", "Failed to compile the export program, nothing was exported.", pfd::choice::ok, pfd::icon::error);
+			return;
+		}
+
+		std::filesystem::path base{ fp.result() };
+		const bool exr = base.extension() == ".exr";
+
+		auto outputs = graph->outputNodes();
+		std::map<OutputNode*, size_t> images;
+		for (auto output : outputs) {
+			auto path = base;
+			if (outputs.size() > 1) {
+				path.replace_filename(std::format("{}_{}", base.stem().string(), output->id()));
+			}
+			path.replace_extension(exr ? ".exr" : ".png");
+
+			// 8 bit storage doesn't need 16 bit files
+			auto format = ImageExporter::Format::png16;
+			if (exr) format = ImageExporter::Format::exr;
+			else if (output->format == StorageFormat::rgba8 || output->format == StorageFormat::r8) format = ImageExporter::Format::png8;
+
+			images[output] = exporter->begin(path.string(), format, exportSize, exportSize, storageFormatInfo(output->format).channels);
+		}
+
+		const bool rendered = graph->renderTiled(exportSize, exportSize, exportTileSize, [&](OutputNode* output, const TextureNodeGraph::TileRegion& tile, const TextureNodeGraph::TileRegion& image) {
+			exporter->read(
+				images[output], *output->texture,
+				tile.x - image.x, tile.y - image.y,
+				tile.x, tile.y, tile.width, tile.height
+			);
+		});
+
+		// no program to render with, the images would wait for their pixels forever
+		if (!rendered) {
+			for (const auto& [output, image] : images) {
+				exporter->cancel(image);
+			}
+		}
+
+		// back to the preview size
+		graph->setPipeline(backend, mode);
+		graph->render();
+
+		if (!rendered) {
+			pfd::message message("Error!", "Failed to render the outputs, nothing was exported.", pfd::choice::ok, pfd::icon::error);
+		}
+	}
+
 	bool openNodeGraph(const std::string_view& file) {
 
 		olc::utils::datafile in{};
 		if(!in.Read(in, std::string(file)))
 			return false;
 
+		// one graph rebuild for the whole file instead of one per connection
+		ned->beginEdit();
+
+		// saved id -> node. Nodes whose saved id is taken (the graph isn't empty) or out of range keep their new id
+		std::unordered_map<size_t, VisualNode*> loaded;
+
 		// create nodes
 		for (size_t i = 0; i < in["nodes"].GetArraySize(); i++) {
 			auto&& val = in["nodes"].GetArrayItem(i);
 			auto&& node = createNewTextureNode(ned, val["type"].GetString());
 			node->position.x = val["position"].GetInt(0);
 			node->position.y = val["position"].GetInt(1);
+
+			const size_t savedId = size_t(val["id"].GetInt());
+			if (!ned->setOriginalNodeId(node, savedId)) {
+				std::cout << std::format("[WARNING] node id {} is taken or out of range, loaded as {}\n", savedId, node->node()->id());
+			}
+			loaded[savedId] = node;
 			static_cast<GraphicsNode*>(node->node())->loadFrom(val);
 
 			nodeTypeStorage[node->node()->id()] = { val["type"].GetString(), node->id() };
@@ -247,20 +419,28 @@ public:
 
 		for (size_t i = 0; i < in["connections"].GetArraySize(); i++) {
 			auto&& val = in["connections"].GetArrayItem(i);
+
+			auto source = loaded.find(size_t(val["source"].GetInt()));
+			auto destination = loaded.find(size_t(val["destination"].GetInt()));
+			if (source == loaded.end() || destination == loaded.end()) continue;
+
 			ned->connect(
-				ned->getFromOriginalNodeId(val["source"].GetInt()),
+				source->second,
 				val["sourceOutput"].GetInt(),
-				ned->getFromOriginalNodeId(val["destination"].GetInt()),
+				destination->second,
 				val["destinationInput"].GetInt()
 			);
 		}
 
+		ned->commitEdit();
+
 		return true;
 
 	}
 
 	NodeEditor* ned;
 	TextureNodeGraph* graph;
+	ImageExporter* exporter{ nullptr };
 	std::map<size_t, std::pair<std::string, size_t>> nodeTypeStorage;
 
 	GUISystem* gui;
@@ -269,6 +449,15 @@ public:
 	float bgColor[3] = { 0.1f, 0.2f, 0.4f };
 
 	TextureView* previewControl;
+	size_t previewNodeId{ 0 };
+	std::shared_ptr<Texture> previewTexture;
+
+	Label* lblStatus{ nullptr };
+	float statusTime{ 0.0f }; // seconds the status stays up
+	static constexpr float statusDuration = 4.0f;
+
+	Panel* pnlProfiler{ nullptr };
+	std::vector<Label*> profilerLines;
 };
 
 int main(int argc, char** argv) {